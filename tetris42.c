@@ -15,6 +15,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <math.h>
 
@@ -22,13 +26,35 @@
     #include <emscripten/emscripten.h>
 #endif
 
+#if !defined(PLATFORM_WEB) && (defined(__unix__) || defined(__APPLE__))
+    #define SUPPORT_POSIX_MMAP
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 //----------------------------------------------------------------------------------
 // Some Defines
 //----------------------------------------------------------------------------------
 // #define SQUARE_SIZE             20
 
-#define GRID_HORIZONTAL_SIZE    12
-#define GRID_VERTICAL_SIZE      20
+// Grid size limits, the grid includes the side walls and the floor
+#define GRID_MAX_HORIZONTAL_SIZE    32
+#define GRID_MAX_VERTICAL_SIZE      64
+
+// Player slots: up to MAX_LOCAL_PLAYERS sharing the screen, or the local player and the opponents of a lobby
+#define MAX_LOCAL_PLAYERS           4
+#define MAX_LOBBY_OPPONENTS         99
+#define MAX_PLAYER_SLOTS            (1 + MAX_LOBBY_OPPONENTS)
+
+#if defined(__GNUC__)
+    #define BOARD_KERNEL        static inline __attribute__((always_inline))
+    #define BOARD_UNROLL        _Pragma("GCC unroll 32")
+#else
+    #define BOARD_KERNEL        static inline
+    #define BOARD_UNROLL
+#endif
 
 #define LATERAL_SPEED           10
 #define TURNING_SPEED           12
@@ -36,11 +62,232 @@
 
 #define FADING_TIME             33
 
+// Lateral auto repeat: first move on press, next after AUTO_SHIFT_DELAY frames, then every AUTO_REPEAT_RATE frames
+#define AUTO_SHIFT_DELAY        LATERAL_SPEED
+#define AUTO_REPEAT_RATE        LATERAL_SPEED
+
+// Input events (see InputPoll())
+#define INPUT_QUEUE_SIZE        64      // Pending input events per player, must be a power of two
+
+// Player metrics (see UpdateMetrics())
+#define METRICS_REFRESH         30      // Frames between HUD updates of the rates
+#define METRICS_HEIGHT_BANDS    4       // Time at height is kept per quarter of the playfield rows
+
+// Training data export (see ExportOpen())
+#define EXPORT_MAGIC            "T42XPORT"
+#define EXPORT_VERSION          1
+#define EXPORT_BOARD_ROWS       64      // Max interior rows stored per record, one bit per interior column
+#define EXPORT_GROW_RECORDS     65536   // Records added to the mapping every time the file grows
+
+// Input to photon latency measurement (see LatencyPresent())
+#define LATENCY_SAMPLES         4096    // Samples kept per player for the percentiles
+#define LATENCY_PENDING         16      // Presses per player and frame waiting for the frame to be presented
+#define LATENCY_REFRESH         30      // Frames between percentile updates
+
+// Game events (see EmitEvent())
+#define EVENT_RING_SIZE         256     // Events kept per player, must be a power of two
+
+// Live state feed (see FeedOpen())
+#define FEED_MAGIC              0x44463234      // "42FD"
+#define FEED_VERSION            2
+#define FEED_MAX_COLUMNS        32
+#define FEED_MAX_ROWS           64
+#define FEED_MAX_PLAYERS        MAX_LOCAL_PLAYERS
+
+// Lobby opponents (see LobbyUpdateAtlas())
+#define BOT_CHANGE_ODDS         12      // One in BOT_CHANGE_ODDS frames a bot changes the controls it holds
+#define BOT_RESTART_DELAY       120     // Frames a bot waits after its game over before playing again
+
 //----------------------------------------------------------------------------------
 // Types and Structures Definition
 //----------------------------------------------------------------------------------
 typedef enum GridSquare { EMPTY, MOVING, FULL, BLOCK, FADING } GridSquare;
 
+// Board logic for one grid size (see BOARD_OPS()), the interface every engine implements
+typedef struct BoardOps {
+    const char *name;
+    void (*ResolveFallingMovement)(bool *detection, bool *pieceActive, int Gr);
+    bool (*ResolveLateralMovement)(void);
+    bool (*ResolveTurnMovement)(void);
+    void (*CheckDetection)(bool *detection, int Gr);
+    void (*CheckCompletion)(bool *lineToDelete, int Gr);
+    int (*DeleteCompleteLines)(void);
+} BoardOps;
+
+// Events emitted by the simulation, value meaning depends on the type
+typedef enum GameEventType {
+    EVENT_GAME_START,       // value: game number
+    EVENT_PIECE_SPAWN,      // value: piece type, x/y: piece position
+    EVENT_PIECE_LOCK,       // value: piece type, x/y: piece position, top: grid row of its highest square
+    EVENT_LINES_MARKED,     // value: completed lines starting to fade
+    EVENT_LINES_CLEARED,    // value: lines of the game so far, x: lines deleted
+    EVENT_LEVEL_CHANGE,     // value: new level
+    EVENT_GAME_OVER,        // value: total lines
+    EVENT_PIECE_TURN,       // value: piece type, x/y: piece position
+    EVENT_ACTION,           // value: PlayerAction pressed
+    EVENT_PIECE_MOVE,       // value: piece type, x/y: piece position after a lateral move
+    EVENT_PIECE_FALL,       // value: piece type, x/y: piece position after falling a row
+    EVENT_GAME_PAUSE,       // value: 0, every player gets it
+    EVENT_GAME_RESUME,      // value: 0, every player gets it
+} GameEventType;
+
+typedef struct GameEvent {
+    uint32_t tick;          // framesCounter when the event happened
+    uint8_t type;           // GameEventType
+    uint8_t player;
+    int16_t value;
+    int8_t x;
+    int8_t y;
+    int8_t top;
+    uint8_t reserved;
+} GameEvent;
+
+// Single producer ring of the last EVENT_RING_SIZE events of a player. The
+// simulation is the only writer; any number of consumers, on any thread, keep
+// their own EventReader cursor and see every event unless they fall
+// EVENT_RING_SIZE - 1 events behind or more (the next slot may be in the middle
+// of a write), in which case the events they missed are counted as dropped.
+typedef struct EventRing {
+    GameEvent events[EVENT_RING_SIZE];
+    _Atomic uint32_t head;  // Events written since start
+} EventRing;
+
+typedef struct EventReader {
+    uint32_t position;      // Next event to read
+    uint32_t dropped;       // Events overwritten before this reader got to them
+} EventReader;
+
+// Player controls, also used as bit numbers of the feed input buttons
+typedef enum PlayerAction { ACTION_LEFT, ACTION_RIGHT, ACTION_TURN, ACTION_DOWN, ACTION_COUNT } PlayerAction;
+
+typedef enum InputSource { INPUT_DEVICE, INPUT_FEED, INPUT_SCRIPT, INPUT_BOT } InputSource;
+
+// A press or release of a player control, applied on the simulation frame given by tick
+typedef struct InputEvent {
+    double time;            // GetTime() of the poll that saw the event
+    double arrival;         // GetTime() of the poll before, the input arrived after it
+    uint32_t tick;          // framesCounter of the frame that applies it
+    uint8_t player;
+    uint8_t action;         // PlayerAction
+    uint8_t pressed;        // Press or release
+    uint8_t source;         // InputSource
+} InputEvent;
+
+typedef struct InputQueue {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    uint32_t head;          // Events queued since start
+    uint32_t tail;          // Events applied since start
+} InputQueue;
+
+// Statistics of the current game of a player, kept up to date from its events
+typedef struct PlayerMetrics {
+    bool playing;
+    int game;
+    uint32_t startTick;             // Tick of the game start
+    uint32_t endTick;               // Tick of the game over, while playing the current tick is used
+    bool paused;
+    uint32_t pauseTick;             // Tick of the pause, while paused
+    uint32_t pausedFrames;          // Frames spent paused since the game start, the last pause excluded while paused
+    uint32_t pieces;                // Pieces locked
+    uint32_t actions;               // Control presses while playing
+    uint32_t finesseFaults;         // Presses beyond the minimum of each placement
+    uint32_t clears[4];             // Singles, doubles, triples and tetrises
+    uint32_t heightFrames[METRICS_HEIGHT_BANDS];    // Unpaused frames spent with the stack in each band
+    int height;                     // Stack height in rows
+    uint32_t heightTick;            // Tick since which the stack is at height, or was when paused
+
+    // Placement of the active piece
+    bool placing;
+    int pieceType;
+    int spawnX;
+    int placementInputs;            // Left, right and turn presses since the spawn
+    int placementTurns;             // Turns done since the spawn
+} PlayerMetrics;
+
+// Export file header, followed by recordCount fixed size ExportRecord entries.
+// Both structures only hold naturally aligned fixed width fields so the file
+// can be mapped and read in place by downstream tools. Fields are stored in
+// the byte order of the machine that wrote the file, little-endian on every
+// supported platform. While the game runs, a reader of the mapping loads
+// recordCount with acquire semantics; the records below that count are complete
+typedef struct ExportHeader {
+    char magic[8];                  // EXPORT_MAGIC, not null terminated
+    uint32_t version;               // EXPORT_VERSION
+    uint32_t headerSize;            // sizeof(ExportHeader), offset of the first record
+    uint32_t recordSize;            // sizeof(ExportRecord)
+    uint32_t boardRows;             // EXPORT_BOARD_ROWS
+    _Atomic uint64_t recordCount;   // Records written so far, kept up to date while playing (release store)
+    uint8_t reserved[32];
+} ExportHeader;
+
+// One piece placement: board before the lock, pieces, chosen placement and outcome
+typedef struct ExportRecord {
+    uint32_t tick;                  // Frame the piece locked on
+    uint32_t game;                  // Game number of this player since start
+    uint32_t pieceIndex;            // Piece number inside the game
+    uint32_t totalLines;            // Lines cleared in the game before this placement
+    uint8_t player;
+    uint8_t pieceType;              // GetRandompiece() shape id, 0..6
+    uint8_t incomingType;
+    uint8_t linesCleared;           // Outcome: lines completed by this placement
+    int8_t positionX;               // Outcome: piecePositionX/Y at lock (placement of the 4x4 piece matrix)
+    int8_t positionY;
+    uint8_t width;                  // Interior board size
+    uint8_t height;
+    uint16_t piece;                 // Locked piece matrix as rotated, bit (i*4 + j) set for piece[i][j]
+    uint16_t incoming;              // Incoming piece matrix, same layout
+    uint8_t gameOver;               // Outcome: placement ended the game
+    uint8_t level;
+    uint16_t reserved;
+    uint32_t board[EXPORT_BOARD_ROWS];  // FULL squares before the lock, row 0 at top, bit (i - 1) for column i
+} ExportRecord;
+
+_Static_assert(sizeof(ExportHeader) == 64, "export header layout changed");
+_Static_assert(sizeof(ExportRecord) == 32 + 4*EXPORT_BOARD_ROWS, "export record layout changed");
+
+#if defined(SUPPORT_POSIX_MMAP)
+// Live state of one player slot in the shared memory feed.
+// The state part is guarded by a seqlock, readers never block the game:
+//   1. s1 = sequence (acquire), retry while odd
+//   2. copy the fields needed
+//   3. acquire fence, s2 = sequence, retry if s1 != s2
+// The input part is written by an external process: it stores its pid to
+// inputOwner to take the slot over (0 gives it back to the keyboard) and a
+// (1 << PlayerAction) mask of the held buttons to inputButtons. It also
+// increments inputPresses[action] on every press, so a press released before
+// the game reads the slot still counts as a tap.
+typedef struct FeedPlayer {
+    _Alignas(64) _Atomic uint32_t sequence;     // Odd while the game is writing the slot
+    uint32_t tick;                              // framesCounter of the last update
+    int32_t lines;
+    int32_t level;
+    int32_t positionX;                          // Active piece matrix position in the grid
+    int32_t positionY;
+    uint8_t gameOver;
+    uint8_t pieceActive;
+    uint8_t pieceType;
+    uint8_t incomingType;
+    uint16_t piece;                             // Active piece matrix, bit (i*4 + j) set for piece[i][j]
+    uint16_t incoming;                          // Next piece matrix, same layout
+    uint8_t width;                              // Grid size including the walls and the floor
+    uint8_t height;
+    uint8_t reserved[2];
+    uint8_t cells[FEED_MAX_ROWS][FEED_MAX_COLUMNS];     // GridSquare of each square, cells[j][i]
+
+    _Alignas(64) _Atomic uint32_t inputOwner;   // Non zero while an external process drives the player
+    _Atomic uint32_t inputButtons;
+    _Atomic uint32_t inputPresses[ACTION_COUNT];    // Presses of each button since the feed was opened
+} FeedPlayer;
+
+typedef struct FeedRegion {
+    uint32_t magic;                 // FEED_MAGIC
+    uint32_t version;               // FEED_VERSION
+    uint32_t size;                  // sizeof(FeedRegion)
+    uint32_t players;               // Player slots in use
+    FeedPlayer player[FEED_MAX_PLAYERS];
+} FeedRegion;
+#endif
+
 //------------------------------------------------------------------------------------
 // Global Variables Declaration
 //------------------------------------------------------------------------------------
@@ -50,47 +297,149 @@ static int screenHeight = 1080;
 // static int screenHeight = 225;
 
 static int SQUARE_SIZE;
-static int MAX_PLAYERS = 2;
+
+// Grid size, chosen at startup with -board
+static int gridHorizontalSize = 12;
+static int gridVerticalSize = 20;
+static int gridHiddenRows = 0;          // Top rows not drawn
+static int gridSpawnRow = 0;            // Row pieces appear on, just above the visible ones
+static const BoardOps *board = NULL;
+static int MAX_PLAYERS = 2;             // Player slots simulated
+static int localPlayers = 2;            // Slots played from this machine, the rest are lobby opponents
 static int Gr = 0;
 static int masterOffsetX = 0;
 static int masterOffsetY = 0;
 
-static bool gameOver [4] = {false, false, false, false};
-static bool pause = false;
+static bool gameOver [MAX_PLAYER_SLOTS] = { 0 };
+static bool gamePaused = false;
+static unsigned int framesCounter = 0;
 
 // Matrices
-static GridSquare grid [4][GRID_HORIZONTAL_SIZE][GRID_VERTICAL_SIZE];
-static GridSquare piece [4][4][4];
-static GridSquare incomingPiece [4][4][4];
+static GridSquare grid [MAX_PLAYER_SLOTS][GRID_MAX_HORIZONTAL_SIZE][GRID_MAX_VERTICAL_SIZE];
+static GridSquare piece [MAX_PLAYER_SLOTS][4][4];
+static GridSquare incomingPiece [MAX_PLAYER_SLOTS][4][4];
 
 // Theese variables keep track of the active piece position
-static int piecePositionX[4] = {0, 0, 0, 0};
-static int piecePositionY[4] = {0, 0, 0, 0};
+static int piecePositionX[MAX_PLAYER_SLOTS] = { 0 };
+static int piecePositionY[MAX_PLAYER_SLOTS] = { 0 };
 
 // Game parameters
-static Color fadingColor[4];
+static Color fadingColor[MAX_PLAYER_SLOTS];
 //static int fallingSpeed;           // In frames
 
-static bool beginPlay [4] = {true, true, true, true};      // This var is only true at the begining of the game, used for the first matrix creations
-static bool pieceActive [4] = {false, false, false, false};
-static bool detection [4] = {false, false, false, false};
-static bool lineToDelete [4] = {false, false, false, false};
+static bool beginPlay [MAX_PLAYER_SLOTS] = { 0 };      // This var is only true at the begining of the game, used for the first matrix creations
+static bool pieceActive [MAX_PLAYER_SLOTS] = { 0 };
+static bool detection [MAX_PLAYER_SLOTS] = { 0 };
+static bool lineToDelete [MAX_PLAYER_SLOTS] = { 0 };
+
+// Theese variables keep track of the shape ids handed out by GetRandompiece()
+static int pieceType[MAX_PLAYER_SLOTS] = { 0 };
+static int incomingPieceType[MAX_PLAYER_SLOTS] = { 0 };
 
 // Statistics
-static int level[4] = {1, 1, 1, 1};
-static int lines[4] = {0, 0, 0, 0};
+static int level[MAX_PLAYER_SLOTS] = { 0 };
+static int lines[MAX_PLAYER_SLOTS] = { 0 };
+static int games[MAX_PLAYER_SLOTS] = { 0 };
+static int pieces[MAX_PLAYER_SLOTS] = { 0 };
 
 // Counters
-static int gravityMovementCounter [4] = {0, 0, 0, 0};
-static int lateralMovementCounter [4] = {0, 0, 0, 0};
-static int turnMovementCounter [4] = {0, 0, 0, 0};
-static int fastFallMovementCounter [4] = {0, 0, 0, 0};
+static int gravityMovementCounter [MAX_PLAYER_SLOTS] = { 0 };
+static int lateralMovementCounter [MAX_PLAYER_SLOTS] = { 0 };
+static int lateralMovementDelay [MAX_PLAYER_SLOTS] = { 0 };
+static int turnMovementCounter [MAX_PLAYER_SLOTS] = { 0 };
+static int fastFallMovementCounter [MAX_PLAYER_SLOTS] = { 0 };
 
-static int fadeLineCounter [4] = {0, 0, 0, 0};
+static int fadeLineCounter [MAX_PLAYER_SLOTS] = { 0 };
 
 // Based on level
 static int gravitySpeed = 30;
 
+// Latency measurement, enabled with -latency <file>
+static FILE *latencyFile = NULL;
+static InputEvent latencyPending[MAX_LOCAL_PLAYERS][LATENCY_PENDING];   // Presses consumed by the current frame
+static int latencyPendingCount[MAX_LOCAL_PLAYERS] = {0, 0, 0, 0};
+static float latencySamples[MAX_LOCAL_PLAYERS][LATENCY_SAMPLES];        // Last latencies in milliseconds, circular
+static unsigned int latencySampleCount[MAX_LOCAL_PLAYERS] = {0, 0, 0, 0};
+static float latencyP50[MAX_LOCAL_PLAYERS] = {0, 0, 0, 0};
+static float latencyP99[MAX_LOCAL_PLAYERS] = {0, 0, 0, 0};
+static double inputPollTime = 0.0;      // GetTime() right after the last raylib input poll
+static double inputPollPrevious = 0.0;  // The poll before it
+#if defined(SUPPORT_CUSTOM_FRAME_CONTROL) && !defined(PLATFORM_WEB)
+static double framePacingTime = 0.0;    // GetTime() when the last frame wait ended
+#endif
+
+// Game events, one ring per player
+static EventRing events[MAX_PLAYER_SLOTS];
+
+// HUD, rebuilt from the events instead of every frame
+static EventReader hudReader[MAX_PLAYER_SLOTS];
+static char hudLinesText[MAX_PLAYER_SLOTS][32];
+
+// Player metrics, written at every game over with -metrics <file>
+static FILE *metricsFile = NULL;
+static PlayerMetrics metrics[MAX_PLAYER_SLOTS];
+static EventReader metricsReader[MAX_PLAYER_SLOTS];
+static char hudMetricsText[MAX_PLAYER_SLOTS][4][40];
+
+// Training data export, enabled with -export <file>
+static int exportFile = -1;
+static uint8_t *exportBase = NULL;      // Mapped file: ExportHeader followed by the records
+static uint64_t exportCapacity = 0;     // Records that fit in the current mapping
+static ExportRecord exportPending[MAX_PLAYER_SLOTS];   // Placement waiting for its outcome
+static bool exportHasPending[MAX_PLAYER_SLOTS] = { 0 };
+
+// Live state feed, enabled with -feed <name>
+#if defined(SUPPORT_POSIX_MMAP)
+static FeedRegion *feed = NULL;
+static char feedName[256] = { 0 };
+static int feedPlayers = 0;             // Slots in use, kept here as any input client can write the region
+static uint32_t feedPressCount[FEED_MAX_PLAYERS][ACTION_COUNT] = { 0 };    // inputPresses seen by the last FeedReadInput()
+#endif
+static bool feedDriven[MAX_PLAYER_SLOTS] = { 0 };       // Player input comes from the feed this tick
+static unsigned int feedButtons[MAX_PLAYER_SLOTS] = { 0 };
+static unsigned int feedPresses[MAX_PLAYER_SLOTS] = { 0 };      // Buttons pressed since the last frame, held or not
+
+// Player controls, indexed by PlayerAction. Player N also uses gamepad N
+static const int actionKeys[MAX_LOCAL_PLAYERS][ACTION_COUNT] = {
+    { KEY_A, KEY_D, KEY_W, KEY_S },
+    { KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN },
+    { KEY_J, KEY_L, KEY_I, KEY_K },
+    { KEY_KP_4, KEY_KP_6, KEY_KP_8, KEY_KP_5 },
+};
+static const int actionButtons[ACTION_COUNT] = {
+    GAMEPAD_BUTTON_LEFT_FACE_LEFT, GAMEPAD_BUTTON_LEFT_FACE_RIGHT, GAMEPAD_BUTTON_LEFT_FACE_UP, GAMEPAD_BUTTON_LEFT_FACE_DOWN
+};
+
+// Input events waiting for their frame and the resulting control state, (1 << PlayerAction) masks
+static InputQueue inputQueue[MAX_PLAYER_SLOTS];
+static unsigned int inputSampled[MAX_PLAYER_SLOTS] = { 0 };     // Device state seen by the last InputPoll()
+static unsigned int inputDown[MAX_PLAYER_SLOTS] = { 0 };        // Held after the events of this frame
+static unsigned int inputPressed[MAX_PLAYER_SLOTS] = { 0 };     // Pressed during this frame
+
+// Scripted input, enabled with -script <file>
+static InputEvent *scriptEvents = NULL;
+static int scriptCount = 0;
+static int scriptNext = 0;
+static bool scriptDriven[MAX_PLAYER_SLOTS] = { 0 };     // Devices are ignored for scripted players
+
+// Piece generator state of each player, see -seed
+static uint32_t pieceRandom[MAX_PLAYER_SLOTS] = { 0 };
+
+// Lobby, enabled with -lobby <opponents>. Until there is networking the
+// opponents are played by bots, seeded like the pieces
+static int lobbyOpponents = 0;
+static int lobbyFocus = 1;              // Opponent drawn in full detail
+static uint32_t botRandom[MAX_PLAYER_SLOTS] = { 0 };
+static int botRestartCounter[MAX_PLAYER_SLOTS] = { 0 };
+
+// Opponents atlas: one texel per visible cell, boards in rows of atlasColumns
+// with a blank texel between them. Only the boards changed since the last
+// frame are uploaded, the whole atlas is then drawn at once
+static EventReader atlasReader[MAX_PLAYER_SLOTS];
+static bool atlasFading[MAX_PLAYER_SLOTS] = { 0 };  // Lines marked and not cleared yet, their color changes every frame
+static Texture2D atlas = { 0 };
+static int atlasColumns = 0;
+
 //------------------------------------------------------------------------------------
 // Module Functions Declaration (local)
 //------------------------------------------------------------------------------------
@@ -103,22 +452,181 @@ static void UpdateDrawFrame(void);  // Update and Draw (one frame)
 // Additional module functions
 static bool Createpiece();
 static void GetRandompiece();
-static void ResolveFallingMovement(bool *detection, bool *pieceActive, int Gr);
-static bool ResolveLateralMovement();
-static bool ResolveTurnMovement();
-static void CheckDetection(bool *detection, int Gr);
-static void CheckCompletion(bool *lineToDelete, int Gr);
-static int DeleteCompleteLines();
+static void SelectBoardOps(void);
+static bool IsActionDown(PlayerAction action);
+static bool IsActionPressed(PlayerAction action);
+static uint16_t GetPieceMask(GridSquare matrix[4][4]);
+static int CountFadingLines(void);
+static int GetPieceRandomValue(int max);
+static int GetBotRandomValue(int player, int max);
+static bool ParseCount(const char *text, int min, int max, int *value);
+static int GetPieceTop(void);
+
+// Input functions
+static bool InputLoadScript(const char *fileName);
+static void InputPoll(void);
+static void InputApply(void);
+
+// Latency measurement functions
+static bool LatencyOpen(const char *fileName);
+static void LatencyClose(void);
+static void LatencyPresent(double presentTime);
+static void InputPolled(void);
+
+// Game event functions
+static void EmitEvent(GameEventType type, int value, int x, int y);
+static void EmitEventTop(GameEventType type, int value, int x, int y, int top);
+static void EmitPieceLock(int top);
+static bool PollEvent(int player, EventReader *reader, GameEvent *event);
+static void UpdateHud(void);
+
+// Player metrics functions
+static bool MetricsOpen(const char *fileName);
+static void MetricsClose(void);
+static void UpdateMetrics(void);
+
+// Training data export functions
+static bool ExportOpen(const char *fileName);
+static void ExportClose(void);
+static void ExportBeginPlacement(void);
+static void ExportEndPlacement(void);
+
+// Lobby functions
+static void LobbyInit(void);
+static void LobbyClose(void);
+static void LobbyUpdateAtlas(Color C1, Color C2, Color C3);
+static void LobbyDraw(void);
+
+// Live state feed functions
+static bool FeedOpen(const char *name);
+static void FeedClose(void);
+static void FeedReadInput(void);
+static void FeedPublish(void);
+
+// Reference engine harness functions
+static int HarnessRun(unsigned int ticks, uint32_t seed);
 
 //------------------------------------------------------------------------------------
 // Program main entry point
 //------------------------------------------------------------------------------------
-int main(void)
+int main(int argc, char *argv[])
 {
+    uint32_t seed = (uint32_t)time(NULL);
+    const char *feedObjectName = NULL;
+    const char *scriptFileName = NULL;
+    int harnessTicks = 0;
+
+    // Command line options
+    //---------------------------------------------------------
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-export") == 0) && (i + 1 < argc))
+        {
+            if (!ExportOpen(argv[++i])) return 1;
+        }
+        else if ((strcmp(argv[i], "-feed") == 0) && (i + 1 < argc))
+        {
+            feedObjectName = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-script") == 0) && (i + 1 < argc))
+        {
+            scriptFileName = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-metrics") == 0) && (i + 1 < argc))
+        {
+            if (!MetricsOpen(argv[++i])) return 1;
+        }
+        else if ((strcmp(argv[i], "-latency") == 0) && (i + 1 < argc))
+        {
+            if (!LatencyOpen(argv[++i])) return 1;
+        }
+        else if ((strcmp(argv[i], "-players") == 0) && (i + 1 < argc) && ParseCount(argv[i + 1], 1, MAX_LOCAL_PLAYERS, &MAX_PLAYERS))
+        {
+            i++;
+        }
+        else if ((strcmp(argv[i], "-lobby") == 0) && (i + 1 < argc) && ParseCount(argv[i + 1], 1, MAX_LOBBY_OPPONENTS, &lobbyOpponents))
+        {
+            i++;
+        }
+        else if ((strcmp(argv[i], "-board") == 0) && (i + 1 < argc))
+        {
+            // <columns>x<rows>[:<hidden rows>], the playfield without walls and floor
+            int columns = 0, rows = 0, hidden = 0, length = 0;
+
+            // length ends up past the last field parsed, anything left after it is junk
+            if ((sscanf(argv[++i], "%dx%d%n:%d%n", &columns, &rows, &length, &hidden, &length) < 2) || (argv[i][length] != '\0') || (columns < 4) || (columns > GRID_MAX_HORIZONTAL_SIZE - 2) ||
+                (rows < 4) || (rows > GRID_MAX_VERTICAL_SIZE - 1) || (hidden < 0) || (hidden > rows - 4))
+            {
+                printf("Invalid board size %s, up to %ix%i\n", argv[i], GRID_MAX_HORIZONTAL_SIZE - 2, GRID_MAX_VERTICAL_SIZE - 1);
+                return 1;
+            }
+
+            gridHorizontalSize = columns + 2;
+            gridVerticalSize = rows + 1;
+            gridHiddenRows = hidden;
+            gridSpawnRow = (hidden > 2)? hidden - 2 : 0;
+        }
+        else if ((strcmp(argv[i], "-seed") == 0) && (i + 1 < argc))
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if ((strcmp(argv[i], "-harness") == 0) && (i + 1 < argc) && ParseCount(argv[i + 1], 1, INT_MAX, &harnessTicks))
+        {
+            i++;
+        }
+        else
+        {
+            printf("Usage: %s [-players <1-4>] [-lobby <opponents 1-99>] [-board <columns>x<rows>[:<hidden>]] [-seed <n>] [-harness <ticks>] [-script <file>] [-latency <file>] [-metrics <file>] [-export <file>] [-feed <shm name>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The harness plays bots only and compares and times the engines alone, outside input and
+    // the per frame outputs would make the two slots differ or land in the files once per pass
+    if ((harnessTicks > 0) && ((scriptFileName != NULL) || (feedObjectName != NULL) || (exportBase != NULL) || (metricsFile != NULL) || (latencyFile != NULL)))
+    {
+        printf("-harness cannot be combined with -script, -feed, -export, -metrics or -latency\n");
+        UnloadGame();
+        return 1;
+    }
+
+    // A lobby is the local player against its opponents, whatever -players says
+    if (lobbyOpponents > 0) MAX_PLAYERS = 1 + lobbyOpponents;
+    localPlayers = (lobbyOpponents > 0)? 1 : MAX_PLAYERS;
+
+    // Loaded once the players are known, a script line for a missing player is an error
+    if ((scriptFileName != NULL) && !InputLoadScript(scriptFileName)) return 1;
+
+    // Every player gets its own piece sequence, the same ones for the same seed
+    for (int p = 0; p < MAX_PLAYER_SLOTS; p++)
+    {
+        pieceRandom[p] = (seed + p)*2654435761u | 1;
+        botRandom[p] = (seed + p)*2246822519u | 1;
+    }
+
+    if ((feedObjectName != NULL) && !FeedOpen(feedObjectName)) return 1;
+
+    SelectBoardOps();
+
+    // Check the engine picked for the board against the reference one and quit, no window needed
+    if (harnessTicks > 0)
+    {
+        int result = HarnessRun((unsigned int)harnessTicks, seed);
+        UnloadGame();
+
+        return result;
+    }
+
     // Initialization (Note windowTitle is unused on Android)
     //---------------------------------------------------------
     InitWindow(screenWidth, screenHeight, "classic game: tetris");
 
+    // The first frame samples the input polled by InitWindow(), nothing arrived before it
+    inputPollTime = GetTime();
+    inputPollPrevious = inputPollTime;
+
+    if (lobbyOpponents > 0) LobbyInit();
+
     for (int p = 0; p < MAX_PLAYERS; p++)
     {
         Gr = p;
@@ -159,15 +667,24 @@ void InitGame(void)
     // Initialize game statistics
     level[Gr] = 1;
     lines[Gr] = 0;
+    games[Gr]++;
+    pieces[Gr] = 0;
+
+    EmitEvent(EVENT_GAME_START, games[Gr], 0, 0);
+    EmitEvent(EVENT_LEVEL_CHANGE, level[Gr], 0, 0);
 
-    SQUARE_SIZE = screenWidth / 40;
+    // Room for the grid, the incoming piece and the margins of every player, and for the visible rows.
+    // A lobby shows the local player, the focused opponent and the opponents atlas
+    int screenShares = (lobbyOpponents > 0)? 3 : MAX_PLAYERS;
+    SQUARE_SIZE = screenWidth / ((gridHorizontalSize + 8)*((screenShares > 2)? screenShares : 2));
+    if (SQUARE_SIZE > screenHeight/(gridVerticalSize - gridHiddenRows + 2)) SQUARE_SIZE = screenHeight/(gridVerticalSize - gridHiddenRows + 2);
 
     fadingColor[Gr] = GRAY;
 
     piecePositionX[Gr] = 0;
     piecePositionY[Gr] = 0;
 
-    pause = false;
+    gamePaused = false;
 
     beginPlay[Gr] = true;
     pieceActive[Gr] = false;
@@ -177,18 +694,21 @@ void InitGame(void)
     // Counters
     gravityMovementCounter[Gr] = 0;
     lateralMovementCounter[Gr] = 0;
+    lateralMovementDelay[Gr] = LATERAL_SPEED;
     turnMovementCounter[Gr] = 0;
     fastFallMovementCounter[Gr] = 0;
 
     fadeLineCounter[Gr] = 0;
     gravitySpeed = 30;
 
+    botRestartCounter[Gr] = 0;
+
     // Initialize grid matrices
-    for (int i = 0; i < GRID_HORIZONTAL_SIZE; i++)
+    for (int i = 0; i < gridHorizontalSize; i++)
     {
-        for (int j = 0; j < GRID_VERTICAL_SIZE; j++)
+        for (int j = 0; j < gridVerticalSize; j++)
         {
-            if ((j == GRID_VERTICAL_SIZE - 1) || (i == 0) || (i == GRID_HORIZONTAL_SIZE - 1)) grid[Gr][i][j] = BLOCK;
+            if ((j == gridVerticalSize - 1) || (i == 0) || (i == gridHorizontalSize - 1)) grid[Gr][i][j] = BLOCK;
             else grid[Gr][i][j] = EMPTY;
         }
     }
@@ -208,9 +728,7 @@ void UpdateGame(void)
 {
     if (!gameOver[Gr])
     {
-        if (IsKeyPressed('P')) pause = !pause;
-
-        if (!pause)
+        if (!gamePaused)
         {
             if (!lineToDelete[Gr])
             {
@@ -230,67 +748,78 @@ void UpdateGame(void)
                     lateralMovementCounter[Gr]++;
                     turnMovementCounter[Gr]++;
 
-                    if (Gr == 1)
-                    {
-                        // We make sure to move if we've pressed the key this frame
-                        if (IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_RIGHT)) lateralMovementCounter[Gr] = LATERAL_SPEED;
-                        if (IsKeyPressed(KEY_UP)) turnMovementCounter[Gr] = TURNING_SPEED;
-
-                        // Fall down
-                        if (IsKeyDown(KEY_DOWN) && (fastFallMovementCounter[Gr] >= FAST_FALL_AWAIT_COUNTER))
-                        {
-                            // We make sure the piece is going to fall this frame
-                            gravityMovementCounter[Gr] += gravitySpeed;
-                        }
-                    }
+                    // We make sure to move if we've pressed the key this frame
+                    bool lateralPressed = IsActionPressed(ACTION_LEFT) || IsActionPressed(ACTION_RIGHT);
+                    if (lateralPressed) lateralMovementCounter[Gr] = lateralMovementDelay[Gr];
+                    if (IsActionPressed(ACTION_TURN)) turnMovementCounter[Gr] = TURNING_SPEED;
 
-                    if (Gr == 0)
+                    // Fall down
+                    if (IsActionDown(ACTION_DOWN) && (fastFallMovementCounter[Gr] >= FAST_FALL_AWAIT_COUNTER))
                     {
-                        // We make sure to move if we've pressed the key this frame
-                        if (IsKeyPressed(KEY_A) || IsKeyPressed(KEY_D)) lateralMovementCounter[Gr] = LATERAL_SPEED;
-                        if (IsKeyPressed(KEY_W)) turnMovementCounter[Gr] = TURNING_SPEED;
-
-                        // Fall down
-                        if (IsKeyDown(KEY_S) && (fastFallMovementCounter[Gr] >= FAST_FALL_AWAIT_COUNTER))
-                        {
-                            // We make sure the piece is going to fall this frame
-                            gravityMovementCounter[Gr] += gravitySpeed;
-                        }
+                        // We make sure the piece is going to fall this frame
+                        gravityMovementCounter[Gr] += gravitySpeed;
                     }
 
                     if (gravityMovementCounter[Gr] >= gravitySpeed)
                     {
                         // Basic falling movement
-                        CheckDetection(&detection[0], Gr);
+                        board->CheckDetection(&detection[0], Gr);
+
+                        // The piece is going to lock, keep the board as it was before
+                        if (detection[Gr] && (exportBase != NULL)) ExportBeginPlacement();
 
                         // Check if the piece has collided with another piece or with the boundings
-                        ResolveFallingMovement(&detection[0], &pieceActive[0], Gr);
+                        board->ResolveFallingMovement(&detection[0], &pieceActive[0], Gr);
+
+                        if (!pieceActive[Gr]) EmitPieceLock(GetPieceTop());
+                        else EmitEvent(EVENT_PIECE_FALL, pieceType[Gr], piecePositionX[Gr], piecePositionY[Gr]);
 
                         // Check if we fullfilled a line and if so, erase the line and pull down the the lines[Gr] above
-                        CheckCompletion(&lineToDelete[0], Gr);
+                        board->CheckCompletion(&lineToDelete[0], Gr);
+
+                        if (lineToDelete[Gr]) EmitEvent(EVENT_LINES_MARKED, CountFadingLines(), 0, 0);
 
                         gravityMovementCounter[Gr] = 0;
                     }
 
                     // Move laterally at player's will
-                    if (lateralMovementCounter[Gr] >= LATERAL_SPEED)
+                    if (lateralMovementCounter[Gr] >= lateralMovementDelay[Gr])
                     {
                         // Update the lateral movement and if success, reset the lateral counter
-                        if (!ResolveLateralMovement()) lateralMovementCounter[Gr] = 0;
+                        int positionX = piecePositionX[Gr];
+
+                        if (!board->ResolveLateralMovement())
+                        {
+                            lateralMovementCounter[Gr] = 0;
+
+                            // Only an actual move changes the board, held against a wall or without a lateral control nothing moved
+                            if (piecePositionX[Gr] != positionX) EmitEvent(EVENT_PIECE_MOVE, pieceType[Gr], piecePositionX[Gr], piecePositionY[Gr]);
+
+                            // Wait longer before the first auto repeat than between the next ones
+                            lateralMovementDelay[Gr] = lateralPressed? AUTO_SHIFT_DELAY : AUTO_REPEAT_RATE;
+                        }
                     }
 
                     // Turn the piece at player's will
                     if (turnMovementCounter[Gr] >= TURNING_SPEED)
                     {
                         // Update the turning movement and reset the turning counter
-                        if (ResolveTurnMovement()) turnMovementCounter[Gr] = 0;
+                        uint16_t pieceMask = GetPieceMask(piece[Gr]);
+
+                        if (board->ResolveTurnMovement())
+                        {
+                            turnMovementCounter[Gr] = 0;
+
+                            // A blocked turn leaves the piece as it was
+                            if (GetPieceMask(piece[Gr]) != pieceMask) EmitEvent(EVENT_PIECE_TURN, pieceType[Gr], piecePositionX[Gr], piecePositionY[Gr]);
+                        }
                     }
                 }
 
-                // Game over logic
-                for (int j = 0; j < 2; j++)
+                // Game over logic, the stack reached the rows pieces appear on
+                for (int j = gridSpawnRow; j < gridSpawnRow + 2; j++)
                 {
-                    for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+                    for (int i = 1; i < gridHorizontalSize - 1; i++)
                     {
                         if (grid[Gr][i][j] == FULL)
                         {
@@ -298,6 +827,14 @@ void UpdateGame(void)
                         }
                     }
                 }
+
+                if (gameOver[Gr])
+                {
+                    EmitEvent(EVENT_GAME_OVER, lines[Gr], 0, 0);
+                }
+
+                // Lines and game over are known now, the placement is complete
+                if (exportHasPending[Gr]) ExportEndPlacement();
             }
             else
             {
@@ -310,18 +847,23 @@ void UpdateGame(void)
                 if (fadeLineCounter[Gr] >= FADING_TIME)
                 {
                     int deletedLines = 0;
-                    deletedLines = DeleteCompleteLines();
+                    deletedLines = board->DeleteCompleteLines();
                     fadeLineCounter[Gr] = 0;
                     lineToDelete[Gr] = false;
 
                     lines[Gr] += deletedLines;
+
+                    EmitEvent(EVENT_LINES_CLEARED, lines[Gr], deletedLines, 0);
                 }
             }
         }
     }
     else
     {
-        if (IsKeyPressed(KEY_ENTER))
+        // Lobby opponents join the next game on their own
+        if (Gr >= localPlayers) botRestartCounter[Gr] += gamePaused? 0 : 1;
+
+        if (((Gr < localPlayers) && IsKeyPressed(KEY_ENTER)) || (botRestartCounter[Gr] >= BOT_RESTART_DELAY))
         {
             InitGame();
             gameOver[Gr] = false;
@@ -336,16 +878,16 @@ void DrawGame(Color C1, Color C2, Color C3)
         {
             // Draw gameplay area
             Vector2 offset;
-            offset.x = screenWidth/2 - (GRID_HORIZONTAL_SIZE*SQUARE_SIZE/2) - 50 + masterOffsetX;
-            offset.y = screenHeight/2 - ((GRID_VERTICAL_SIZE - 1)*SQUARE_SIZE/2) + SQUARE_SIZE*2;
+            offset.x = screenWidth/2 - (gridHorizontalSize*SQUARE_SIZE/2) - 50 + masterOffsetX;
+            offset.y = screenHeight/2 - ((gridVerticalSize - gridHiddenRows - 1)*SQUARE_SIZE/2) + SQUARE_SIZE*2;
 
             offset.y -= 2*SQUARE_SIZE;
 
             int controller = offset.x;
 
-            for (int j = 0; j < GRID_VERTICAL_SIZE; j++)
+            for (int j = gridHiddenRows; j < gridVerticalSize; j++)
             {
-                for (int i = 0; i < GRID_HORIZONTAL_SIZE; i++)
+                for (int i = 0; i < gridHorizontalSize; i++)
                 {
                     // Draw each square of the grid
                     if (grid[Gr][i][j] == EMPTY)
@@ -384,7 +926,7 @@ void DrawGame(Color C1, Color C2, Color C3)
 
             // Draw incoming piece (semi hardcoded)
 //            offset.x = screenWidth / 2 + 4 * SQUARE_SIZE;
-            offset.x = screenWidth/2 + (GRID_HORIZONTAL_SIZE*SQUARE_SIZE/2) + masterOffsetX;
+            offset.x = screenWidth/2 + (gridHorizontalSize*SQUARE_SIZE/2) + masterOffsetX;
             offset.y = 4 * SQUARE_SIZE;
 
             int controler = offset.x;
@@ -413,11 +955,19 @@ void DrawGame(Color C1, Color C2, Color C3)
             }
 
             DrawText("INCOMING:", offset.x, offset.y - 5*SQUARE_SIZE, SQUARE_SIZE/2, GRAY);
-            DrawText(TextFormat("LINES:   %04i", lines[Gr]), offset.x, offset.y + 20, SQUARE_SIZE/2, GRAY);
+            DrawText(hudLinesText[Gr], offset.x, offset.y + 20, SQUARE_SIZE/2, GRAY);
+
+            if ((latencyFile != NULL) && (Gr < localPlayers) && (latencySampleCount[Gr] > 0))
+            {
+                DrawText(TextFormat("LATENCY: p50 %.1f ms", latencyP50[Gr]), offset.x, offset.y + 20 + SQUARE_SIZE, SQUARE_SIZE/2, GRAY);
+                DrawText(TextFormat("         p99 %.1f ms", latencyP99[Gr]), offset.x, offset.y + 20 + 3*SQUARE_SIZE/2, SQUARE_SIZE/2, GRAY);
+            }
+
+            for (int k = 0; k < 4; k++) DrawText(hudMetricsText[Gr][k], offset.x, offset.y + 20 + (5 + k)*SQUARE_SIZE/2, SQUARE_SIZE/2, GRAY);
 
-            if (pause) DrawText("GAME PAUSED", screenWidth/2 - MeasureText("GAME PAUSED", 40)/2, screenHeight/2 - 40, 40, GRAY);
+            if (gamePaused) DrawText("GAME PAUSED", screenWidth/2 - MeasureText("GAME PAUSED", 40)/2, screenHeight/2 - 40, 40, GRAY);
         }
-        else DrawText("PRESS [ENTER] TO PLAY AGAIN", GetScreenWidth()/2 - MeasureText("PRESS [ENTER] TO PLAY AGAIN", 20)/2, GetScreenHeight()/2 - 50, 20, GRAY);
+        else if (Gr < localPlayers) DrawText("PRESS [ENTER] TO PLAY AGAIN", GetScreenWidth()/2 - MeasureText("PRESS [ENTER] TO PLAY AGAIN", 20)/2, GetScreenHeight()/2 - 50, 20, GRAY);
 
 }
 
@@ -425,35 +975,100 @@ void DrawGame(Color C1, Color C2, Color C3)
 void UnloadGame(void)
 {
     // TODO: Unload all dynamic loaded data (textures, sounds, models...)
+    ExportClose();
+    FeedClose();
+
+    free(scriptEvents);
+    scriptEvents = NULL;
+
+    LatencyClose();
+    MetricsClose();
+    LobbyClose();
 }
 
 // Update and Draw (one frame)
 void UpdateDrawFrame(void)
 {
+    const Color playerColors[4][3] = {
+        { SKYBLUE, BLUE, DARKBLUE },
+        { PURPLE, VIOLET, DARKPURPLE },
+        { BEIGE, BROWN, DARKBROWN },
+        { GREEN, LIME, DARKGREEN },
+    };
+
+    framesCounter++;
+
+    FeedReadInput();
+    InputPoll();
+
+    if (IsKeyPressed('P'))
+    {
+        gamePaused = !gamePaused;
+
+        for (Gr = 0; Gr < MAX_PLAYERS; Gr++) EmitEvent(gamePaused? EVENT_GAME_PAUSE : EVENT_GAME_RESUME, 0, 0, 0);
+        Gr = 0;
+    }
+    if ((lobbyOpponents > 0) && IsKeyPressed(KEY_TAB)) lobbyFocus = lobbyFocus%lobbyOpponents + 1;
+
+    for (Gr = 0; Gr < MAX_PLAYERS; Gr++)
+    {
+        InputApply();
+        UpdateGame();
+    }
     Gr = 0;
-    UpdateGame();
-    Gr++;
-    UpdateGame();
+
+    FeedPublish();
+
+    for (Gr = 0; Gr < MAX_PLAYERS; Gr++)
+    {
+        UpdateMetrics();
+        UpdateHud();
+    }
     Gr = 0;
 
+    if (lobbyOpponents > 0) LobbyUpdateAtlas(playerColors[1][0], playerColors[1][1], playerColors[1][2]);
+
         BeginDrawing();
 
         ClearBackground(RAYWHITE);
 
-        masterOffsetX = -580;
-    DrawGame(SKYBLUE, BLUE, DARKBLUE);
-    Gr++;
-            masterOffsetX = 400;
-
-    DrawGame(PURPLE, VIOLET, DARKPURPLE);
+    // Every player gets an equal part of the screen, board and incoming piece centered in it.
+    // In a lobby the parts go to the local player, the focused opponent and the opponents atlas
+    int screenShares = (lobbyOpponents > 0)? 3 : MAX_PLAYERS;
+    int playerWidth = screenWidth/screenShares;
+    int contentWidth = (gridHorizontalSize + 4)*SQUARE_SIZE + 50;
 
+    for (int share = 0; share < ((lobbyOpponents > 0)? 2 : MAX_PLAYERS); share++)
+    {
+        Gr = ((lobbyOpponents > 0) && (share == 1))? lobbyFocus : share;
+        masterOffsetX = share*playerWidth + (playerWidth - contentWidth)/2 - (screenWidth/2 - gridHorizontalSize*SQUARE_SIZE/2 - 50);
+        DrawGame(playerColors[share][0], playerColors[share][1], playerColors[share][2]);
+    }
+    Gr = 0;
 
-//     DrawGame(BEIGE, BROWN, DARKBROWN, 400);
-//     DrawGame(GREEN, LIME, DARKGREEN, 400);
-//       DrawGame(LIGHTGRAY, GRAY, DARKGRAY, 400);
+    if (lobbyOpponents > 0) LobbyDraw();
 
         EndDrawing();
 
+#if defined(SUPPORT_CUSTOM_FRAME_CONTROL)
+    // raylib is built to leave the buffer swap, the frame pacing and the input poll
+    // to us, so the frame is timed as presented right after the swap
+    SwapScreenBuffer();
+    if (latencyFile != NULL) LatencyPresent(GetTime());
+
+#if !defined(PLATFORM_WEB)
+    double frameEnd = framePacingTime + 1.0/60.0;
+    if (GetTime() < frameEnd) WaitTime(frameEnd - GetTime());
+    framePacingTime = GetTime();
+#endif
+    PollInputEvents();
+    InputPolled();
+#else
+    // EndDrawing() swapped, waited and polled: the present is only known to be before now
+    if (latencyFile != NULL) LatencyPresent(GetTime());
+    InputPolled();
+#endif
+
 }
 
 //--------------------------------------------------------------------------------------
@@ -461,8 +1076,8 @@ void UpdateDrawFrame(void)
 //--------------------------------------------------------------------------------------
 static bool Createpiece()
 {
-    piecePositionX[Gr] = (int)((GRID_HORIZONTAL_SIZE - 4)/2);
-    piecePositionY[Gr] = 0;
+    piecePositionX[Gr] = (int)((gridHorizontalSize - 4)/2);
+    piecePositionY[Gr] = gridSpawnRow;
 
     // If the game is starting and you are going to create the first piece, we create an extra one
     if (beginPlay)
@@ -480,6 +1095,11 @@ static bool Createpiece()
         }
     }
 
+    pieceType[Gr] = incomingPieceType[Gr];
+    pieces[Gr]++;
+
+    EmitEvent(EVENT_PIECE_SPAWN, pieceType[Gr], piecePositionX[Gr], piecePositionY[Gr]);
+
     // We assign a random piece to the incoming one
     GetRandompiece();
 
@@ -488,16 +1108,98 @@ static bool Createpiece()
     {
         for (int j = 0; j < 4; j++)
         {
-            if (piece[Gr][i - (int)piecePositionX[Gr]][j] == MOVING) grid[Gr][i][j] = MOVING;
+            if (piece[Gr][i - (int)piecePositionX[Gr]][j] == MOVING) grid[Gr][i][piecePositionY[Gr] + j] = MOVING;
         }
     }
 
     return true;
 }
 
+// Check player controls after the input events of this frame, a tap shorter than a frame still counts as down
+static bool IsActionDown(PlayerAction action)
+{
+    return ((inputDown[Gr] | inputPressed[Gr]) & (1u << action)) != 0;
+}
+
+static bool IsActionPressed(PlayerAction action)
+{
+    return (inputPressed[Gr] & (1u << action)) != 0;
+}
+
+// Pack a piece matrix in 16 bits, bit (i*4 + j) set for a MOVING matrix[i][j]
+static uint16_t GetPieceMask(GridSquare matrix[4][4])
+{
+    uint16_t mask = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            if (matrix[i][j] == MOVING) mask |= (uint16_t)(1 << (i*4 + j));
+        }
+    }
+
+    return mask;
+}
+
+// Count the lines marked as completed by CheckCompletion()
+static int CountFadingLines(void)
+{
+    int count = 0;
+
+    for (int j = 0; j < gridVerticalSize - 1; j++)
+    {
+        if (grid[Gr][1][j] == FADING) count++;
+    }
+
+    return count;
+}
+
+// Get a random value between 0 and max from the piece generator of the current player (xorshift32)
+static int GetPieceRandomValue(int max)
+{
+    uint32_t x = pieceRandom[Gr];
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pieceRandom[Gr] = x;
+
+    return (int)(x%(uint32_t)(max + 1));
+}
+
+// Get a random value between 0 and max from the bot of a lobby opponent, same generator as the pieces
+static int GetBotRandomValue(int player, int max)
+{
+    uint32_t x = botRandom[player];
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    botRandom[player] = x;
+
+    return (int)(x%(uint32_t)(max + 1));
+}
+
+// Get the grid row of the highest square of the active piece
+static int GetPieceTop(void)
+{
+    for (int j = 0; j < 4; j++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (piece[Gr][i][j] == MOVING) return piecePositionY[Gr] + j;
+        }
+    }
+
+    return piecePositionY[Gr];
+}
+
 static void GetRandompiece()
 {
-    int random = GetRandomValue(0, 6);
+    int random = GetPieceRandomValue(6);
+
+    incomingPieceType[Gr] = random;
 
     for (int i = 0; i < 4; i++)
     {
@@ -519,14 +1221,41 @@ static void GetRandompiece()
     }
 }
 
-static void ResolveFallingMovement(bool *detection, bool *pieceActive, int Gr)
+// Parse a whole decimal number between min and max, value is left alone if it is not one
+static bool ParseCount(const char *text, int min, int max, int *value)
+{
+    char *end = NULL;
+    long number = strtol(text, &end, 10);
+
+    if ((end == text) || (*end != '\0') || (number < min) || (number > max)) return false;
+
+    *value = (int)number;
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Board logic
+//--------------------------------------------------------------------------------------
+// The board functions are written once against the grid size they receive and
+// instantiated through BOARD_OPS(): once for the size chosen at startup, and
+// once for every common size with the size as a constant, where the compiler
+// fully unrolls the loops over the columns. SelectBoardOps() picks the
+// constant version when there is one for the chosen size.
+//
+// These cell scans define how the game plays, quirks included (a turn still
+// runs on the frame its piece locks). Their instance for the size chosen at
+// startup is the reference engine: keep it as it is, and add any faster
+// engine as another BoardOps that -harness checks against it tick by tick.
+BOARD_KERNEL void ResolveFallingMovementSized(bool *detection, bool *pieceActive, int Gr, int horizontalSize, int verticalSize)
 {
     // If we finished moving this piece, we stop it
     if (*(detection + Gr))
     {
-        for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+        for (int j = verticalSize - 2; j >= 0; j--)
         {
-            for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+            BOARD_UNROLL
+            for (int i = 1; i < horizontalSize - 1; i++)
             {
                 if (grid[Gr][i][j] == MOVING)
                 {
@@ -539,9 +1268,10 @@ static void ResolveFallingMovement(bool *detection, bool *pieceActive, int Gr)
     }
     else    // We move down the piece
     {
-        for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+        for (int j = verticalSize - 2; j >= 0; j--)
         {
-            for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+            BOARD_UNROLL
+            for (int i = 1; i < horizontalSize - 1; i++)
             {
                 if (grid[Gr][i][j] == MOVING)
                 {
@@ -555,19 +1285,18 @@ static void ResolveFallingMovement(bool *detection, bool *pieceActive, int Gr)
     }
 }
 
-static bool ResolveLateralMovement()
+BOARD_KERNEL bool ResolveLateralMovementSized(int horizontalSize, int verticalSize)
 {
     bool collision = false;
 
     // Piece movement
-    if ((IsKeyDown(KEY_LEFT) && Gr ==1)
-        || (IsKeyDown(KEY_A) && Gr ==0)
-    ) // Move left
+    if (IsActionDown(ACTION_LEFT)) // Move left
     {
         // Check if is possible to move to left
-        for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+        for (int j = verticalSize - 2; j >= 0; j--)
         {
-            for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+            BOARD_UNROLL
+            for (int i = 1; i < horizontalSize - 1; i++)
             {
                 if (grid[Gr][i][j] == MOVING)
                 {
@@ -580,9 +1309,10 @@ static bool ResolveLateralMovement()
         // If able, move left
         if (!collision)
         {
-            for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+            for (int j = verticalSize - 2; j >= 0; j--)
             {
-                for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)             // We check the matrix from left to right
+                BOARD_UNROLL
+                for (int i = 1; i < horizontalSize - 1; i++)             // We check the matrix from left to right
                 {
                     // Move everything to the left
                     if (grid[Gr][i][j] == MOVING)
@@ -596,19 +1326,18 @@ static bool ResolveLateralMovement()
             piecePositionX[Gr]--;
         }
     }
-    else if ((IsKeyDown(KEY_RIGHT) && Gr ==1)
-            || (IsKeyDown(KEY_D) && Gr ==0)
-    )  // Move right
+    else if (IsActionDown(ACTION_RIGHT))  // Move right
     {
         // Check if is possible to move to right
-        for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+        for (int j = verticalSize - 2; j >= 0; j--)
         {
-            for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+            BOARD_UNROLL
+            for (int i = 1; i < horizontalSize - 1; i++)
             {
                 if (grid[Gr][i][j] == MOVING)
                 {
                     // Check if we are touching the right wall or we have a full square at the right
-                    if ((i+1 == GRID_HORIZONTAL_SIZE - 1) || (grid[Gr][i+1][j] == FULL))
+                    if ((i+1 == horizontalSize - 1) || (grid[Gr][i+1][j] == FULL))
                     {
                         collision = true;
 
@@ -620,9 +1349,10 @@ static bool ResolveLateralMovement()
         // If able move right
         if (!collision)
         {
-            for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+            for (int j = verticalSize - 2; j >= 0; j--)
             {
-                for (int i = GRID_HORIZONTAL_SIZE - 1; i >= 1; i--)             // We check the matrix from right to left
+                BOARD_UNROLL
+                for (int i = horizontalSize - 2; i >= 1; i--)             // We check the matrix from right to left
                 {
                     // Move everything to the right
                     if (grid[Gr][i][j] == MOVING)
@@ -640,80 +1370,86 @@ static bool ResolveLateralMovement()
     return collision;
 }
 
-static bool ResolveTurnMovement()
+// Get a square of the current player grid, squares outside of the grid count as walls
+BOARD_KERNEL GridSquare GetGridSquare(int i, int j, int horizontalSize, int verticalSize)
+{
+    if ((i < 0) || (i >= horizontalSize) || (j < 0) || (j >= verticalSize)) return BLOCK;
+
+    return grid[Gr][i][j];
+}
+
+BOARD_KERNEL bool ResolveTurnMovementSized(int horizontalSize, int verticalSize)
 {
     // Input for turning the piece
-    if ( (IsKeyDown(KEY_UP) && Gr ==1)
-       || (IsKeyDown(KEY_W) && Gr ==0)
-    )
+    if (IsActionDown(ACTION_TURN))
     {
         GridSquare aux;
         bool checker = false;
 
         // Check all turning possibilities
-        if ((grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr]] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr]] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr]] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr], horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr], horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr], horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 3] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr]] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr]] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 3, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr], horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr], horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 3] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 3] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 3] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 3, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 3, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 3, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr]][piecePositionY[Gr]] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 3] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 3] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr], piecePositionY[Gr], horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 3, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 3, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr]] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 2] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 2] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr], horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 2, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 2, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 1] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr]] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr]] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 1, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr], horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr], horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 3] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 1] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 1] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 3, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 1, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 1, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 2] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 3] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 3] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 2, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 3, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 3, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr]] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 1] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 1] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr], horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 1, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 1, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 2] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr]] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr]] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 2, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr], horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr], horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 3] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 2] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 3][piecePositionY[Gr] + 2] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 3, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 2, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 3, piecePositionY[Gr] + 2, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr]][piecePositionY[Gr] + 1] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 3] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 3] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr], piecePositionY[Gr] + 1, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 3, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 3, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 1] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 2] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 2] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 1, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 2, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 2, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 1] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 1] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 1] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 1, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 1, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 1, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 2] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 1] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 1] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 2, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 1, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 1, horizontalSize, verticalSize) != MOVING)) checker = true;
 
-        if ((grid[Gr][piecePositionX[Gr] + 1][piecePositionY[Gr] + 2] == MOVING) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 2] != EMPTY) &&
-            (grid[Gr][piecePositionX[Gr] + 2][piecePositionY[Gr] + 2] != MOVING)) checker = true;
+        if ((GetGridSquare(piecePositionX[Gr] + 1, piecePositionY[Gr] + 2, horizontalSize, verticalSize) == MOVING) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 2, horizontalSize, verticalSize) != EMPTY) &&
+            (GetGridSquare(piecePositionX[Gr] + 2, piecePositionY[Gr] + 2, horizontalSize, verticalSize) != MOVING)) checker = true;
 
         if (!checker)
         {
@@ -742,9 +1478,10 @@ static bool ResolveTurnMovement()
             piece[Gr][1][2] = aux;
         }
 
-        for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+        for (int j = verticalSize - 2; j >= 0; j--)
         {
-            for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+            BOARD_UNROLL
+            for (int i = 1; i < horizontalSize - 1; i++)
             {
                 if (grid[Gr][i][j] == MOVING)
                 {
@@ -757,7 +1494,10 @@ static bool ResolveTurnMovement()
         {
             for (int j = piecePositionY[Gr]; j < piecePositionY[Gr] + 4; j++)
             {
-                if (piece[Gr][i - piecePositionX[Gr]][j - piecePositionY[Gr]] == MOVING)
+                // Squares over the walls, the floor or outside of the grid are dropped, they can only
+                // happen if the piece already locked this frame and the turn did not check anything
+                if ((piece[Gr][i - piecePositionX[Gr]][j - piecePositionY[Gr]] == MOVING) &&
+                    (i >= 1) && (i <= horizontalSize - 2) && (j >= 0) && (j <= verticalSize - 2))
                 {
                     grid[Gr][i][j] = MOVING;
                 }
@@ -770,25 +1510,27 @@ static bool ResolveTurnMovement()
     return false;
 }
 
-static void CheckDetection(bool *detection, int Gr)
+BOARD_KERNEL void CheckDetectionSized(bool *detection, int Gr, int horizontalSize, int verticalSize)
 {
-    for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+    for (int j = verticalSize - 2; j >= 0; j--)
     {
-        for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+        BOARD_UNROLL
+        for (int i = 1; i < horizontalSize - 1; i++)
         {
             if ((grid[Gr][i][j] == MOVING) && ((grid[Gr][i][j+1] == FULL) || (grid[Gr][i][j+1] == BLOCK))) *(detection + Gr) = true;
         }
     }
 }
 
-static void CheckCompletion(bool *lineToDelete, int Gr)
+BOARD_KERNEL void CheckCompletionSized(bool *lineToDelete, int Gr, int horizontalSize, int verticalSize)
 {
     int calculator = 0;
 
-    for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+    for (int j = verticalSize - 2; j >= 0; j--)
     {
         calculator = 0;
-        for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+        BOARD_UNROLL
+        for (int i = 1; i < horizontalSize - 1; i++)
         {
             // Count each square of the line
             if (grid[Gr][i][j] == FULL)
@@ -797,14 +1539,15 @@ static void CheckCompletion(bool *lineToDelete, int Gr)
             }
 
             // Check if we completed the whole line
-            if (calculator == GRID_HORIZONTAL_SIZE - 2)
+            if (calculator == horizontalSize - 2)
             {
                 *(lineToDelete + Gr) = true;
                 calculator = 0;
                 // points++;
 
                 // Mark the completed line
-                for (int z = 1; z < GRID_HORIZONTAL_SIZE - 1; z++)
+                BOARD_UNROLL
+                for (int z = 1; z < horizontalSize - 1; z++)
                 {
                     grid[Gr][z][j] = FADING;
                 }
@@ -813,23 +1556,25 @@ static void CheckCompletion(bool *lineToDelete, int Gr)
     }
 }
 
-static int DeleteCompleteLines()
+BOARD_KERNEL int DeleteCompleteLinesSized(int horizontalSize, int verticalSize)
 {
     int deletedLines = 0;
 
     // Erase the completed line
-    for (int j = GRID_VERTICAL_SIZE - 2; j >= 0; j--)
+    for (int j = verticalSize - 2; j >= 0; j--)
     {
         while (grid[Gr][1][j] == FADING)
         {
-            for (int i = 1; i < GRID_HORIZONTAL_SIZE - 1; i++)
+            BOARD_UNROLL
+            for (int i = 1; i < horizontalSize - 1; i++)
             {
                 grid[Gr][i][j] = EMPTY;
             }
 
             for (int j2 = j-1; j2 >= 0; j2--)
             {
-                for (int i2 = 1; i2 < GRID_HORIZONTAL_SIZE - 1; i2++)
+                BOARD_UNROLL
+                for (int i2 = 1; i2 < horizontalSize - 1; i2++)
                 {
                     if (grid[Gr][i2][j2] == FULL)
                     {
@@ -850,3 +1595,1185 @@ static int DeleteCompleteLines()
 
     return deletedLines;
 }
+
+
+#define BOARD_OPS(name, horizontalSize, verticalSize) \
+    static void ResolveFallingMovement##name(bool *detection, bool *pieceActive, int Gr) { ResolveFallingMovementSized(detection, pieceActive, Gr, horizontalSize, verticalSize); } \
+    static bool ResolveLateralMovement##name(void) { return ResolveLateralMovementSized(horizontalSize, verticalSize); } \
+    static bool ResolveTurnMovement##name(void) { return ResolveTurnMovementSized(horizontalSize, verticalSize); } \
+    static void CheckDetection##name(bool *detection, int Gr) { CheckDetectionSized(detection, Gr, horizontalSize, verticalSize); } \
+    static void CheckCompletion##name(bool *lineToDelete, int Gr) { CheckCompletionSized(lineToDelete, Gr, horizontalSize, verticalSize); } \
+    static int DeleteCompleteLines##name(void) { return DeleteCompleteLinesSized(horizontalSize, verticalSize); } \
+    static const BoardOps boardOps##name = { #name, \
+        ResolveFallingMovement##name, ResolveLateralMovement##name, ResolveTurnMovement##name, \
+        CheckDetection##name, CheckCompletion##name, DeleteCompleteLines##name \
+    };
+
+// The clamps never change the size, -board checks it; they give the compiler the bounds of the grid storage
+#define BOARD_RUNTIME_COLUMNS   ((gridHorizontalSize < GRID_MAX_HORIZONTAL_SIZE)? gridHorizontalSize : GRID_MAX_HORIZONTAL_SIZE)
+#define BOARD_RUNTIME_ROWS      ((gridVerticalSize < GRID_MAX_VERTICAL_SIZE)? gridVerticalSize : GRID_MAX_VERTICAL_SIZE)
+
+BOARD_OPS(Reference, BOARD_RUNTIME_COLUMNS, BOARD_RUNTIME_ROWS)
+BOARD_OPS(12x20, 12, 20)    // 10x19, default
+BOARD_OPS(12x41, 12, 41)    // 10x40, 20 hidden rows
+BOARD_OPS(8x20, 8, 20)      // 6x19
+BOARD_OPS(22x20, 22, 20)    // 20x19
+
+static const struct { int horizontalSize, verticalSize; const BoardOps *ops; } boardSpecializations[] = {
+    { 12, 20, &boardOps12x20 },
+    { 12, 41, &boardOps12x41 },
+    { 8, 20, &boardOps8x20 },
+    { 22, 20, &boardOps22x20 },
+};
+
+// Use the board functions specialized for the current grid size, the reference ones otherwise
+static void SelectBoardOps(void)
+{
+    board = &boardOpsReference;
+
+    for (int k = 0; k < (int)(sizeof(boardSpecializations)/sizeof(boardSpecializations[0])); k++)
+    {
+        if ((boardSpecializations[k].horizontalSize == gridHorizontalSize) &&
+            (boardSpecializations[k].verticalSize == gridVerticalSize)) board = boardSpecializations[k].ops;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Input
+//--------------------------------------------------------------------------------------
+// Every source of player input turns into InputEvent entries queued per player:
+// devices (keyboard and gamepads) and the feed are sampled once per frame and
+// queue the changes, a script queues its events for the frame they name. Each
+// frame InputApply() consumes the events due for that frame in order, so presses
+// and releases are applied at the frame they belong to. A tap released before
+// the frame is simulated still counts for scripts, for the keyboard (through
+// the raylib key pressed queue) and for the feed (through its press counters);
+// gamepad buttons are only seen held at the sampling.
+static void InputQueueEvent(int player, PlayerAction action, bool pressed, InputSource source, uint32_t tick)
+{
+    InputQueue *queue = &inputQueue[player];
+
+    if (queue->head - queue->tail == INPUT_QUEUE_SIZE)
+    {
+        TraceLog(LOG_WARNING, "INPUT: Player %i input queue full, event dropped", player + 1);
+        return;
+    }
+
+    InputEvent *event = &queue->events[queue->head & (INPUT_QUEUE_SIZE - 1)];
+
+    // Bots have no latency to measure and also run without a window. Device and feed
+    // input arrived between the last two polls, a script event is due at the last one
+    event->time = (source == INPUT_BOT)? 0.0 : inputPollTime;
+    event->arrival = ((source == INPUT_DEVICE) || (source == INPUT_FEED))? inputPollPrevious : event->time;
+    event->tick = tick;
+    event->player = (uint8_t)player;
+    event->action = (uint8_t)action;
+    event->pressed = pressed;
+    event->source = (uint8_t)source;
+
+    queue->head++;
+}
+
+// Load a script of input events, one per line: <frame> <player 1-4> <left|right|turn|down> <press|release>
+// Lines must be in frame order, lines starting with '#' are ignored
+static bool InputLoadScript(const char *fileName)
+{
+    static const char *actionNames[ACTION_COUNT] = { "left", "right", "turn", "down" };
+
+    FILE *file = fopen(fileName, "rt");
+
+    if (file == NULL)
+    {
+        TraceLog(LOG_WARNING, "INPUT: [%s] Failed to open input script", fileName);
+        return false;
+    }
+
+    char line[128];
+    int capacity = 0;
+    int lineNumber = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned int tick = 0;
+        int player = 0;
+        char actionName[16] = { 0 };
+        char stateName[16] = { 0 };
+
+        lineNumber++;
+        if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r')) continue;
+
+        int action = ACTION_COUNT;
+        if (sscanf(line, "%u %i %15s %15s", &tick, &player, actionName, stateName) == 4)
+        {
+            for (int a = 0; a < ACTION_COUNT; a++) if (strcmp(actionName, actionNames[a]) == 0) action = a;
+        }
+
+        if ((action == ACTION_COUNT) || (player < 1) || (player > MAX_LOCAL_PLAYERS) || (player > MAX_PLAYERS) ||
+            ((strcmp(stateName, "press") != 0) && (strcmp(stateName, "release") != 0)) ||
+            ((scriptCount > 0) && (tick < scriptEvents[scriptCount - 1].tick)))
+        {
+            TraceLog(LOG_WARNING, "INPUT: [%s] Invalid input script line %i", fileName, lineNumber);
+            fclose(file);
+            return false;
+        }
+
+        if (scriptCount == capacity)
+        {
+            capacity = (capacity == 0)? 256 : capacity*2;
+            InputEvent *grown = (InputEvent *)realloc(scriptEvents, capacity*sizeof(InputEvent));
+
+            if (grown == NULL)
+            {
+                TraceLog(LOG_WARNING, "INPUT: [%s] Not enough memory for the input script", fileName);
+                fclose(file);
+                return false;
+            }
+
+            scriptEvents = grown;
+        }
+
+        InputEvent *event = &scriptEvents[scriptCount++];
+        event->time = 0.0;
+        event->tick = tick;
+        event->player = (uint8_t)(player - 1);
+        event->action = (uint8_t)action;
+        event->pressed = (strcmp(stateName, "press") == 0);
+        event->source = INPUT_SCRIPT;
+
+        scriptDriven[player - 1] = true;
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+// Queue the input events of the current frame from every source
+static void InputPoll(void)
+{
+    while ((scriptNext < scriptCount) && (scriptEvents[scriptNext].tick <= framesCounter))
+    {
+        InputEvent *event = &scriptEvents[scriptNext++];
+        InputQueueEvent(event->player, (PlayerAction)event->action, event->pressed, INPUT_SCRIPT, framesCounter);
+    }
+
+    // Keys pressed since the last frame, even the ones already released
+    unsigned int keyTaps[MAX_LOCAL_PLAYERS] = { 0 };
+
+    for (int key = (localPlayers > 0)? GetKeyPressed() : 0; key != 0; key = GetKeyPressed())
+    {
+        for (int p = 0; (p < localPlayers) && (p < MAX_LOCAL_PLAYERS); p++)
+        {
+            for (int a = 0; a < ACTION_COUNT; a++) if (actionKeys[p][a] == key) keyTaps[p] |= 1u << a;
+        }
+    }
+
+    for (int p = 0; p < MAX_PLAYERS; p++)
+    {
+        if (scriptDriven[p]) continue;
+
+        unsigned int sample = 0;
+        unsigned int taps = 0;
+        InputSource source = INPUT_DEVICE;
+
+        if (feedDriven[p])
+        {
+            sample = feedButtons[p] & ((1u << ACTION_COUNT) - 1);
+            taps = feedPresses[p];
+            source = INPUT_FEED;
+        }
+        else if (p >= localPlayers)
+        {
+            // Lobby opponent, now and then it lets go of its controls and holds others
+            if (GetBotRandomValue(p, BOT_CHANGE_ODDS - 1) == 0) sample = GetBotRandomValue(p, (1 << ACTION_COUNT) - 1);
+            else sample = inputSampled[p];
+
+            source = INPUT_BOT;
+        }
+        else
+        {
+            bool gamepad = IsGamepadAvailable(p);
+
+            for (int a = 0; a < ACTION_COUNT; a++)
+            {
+                if (IsKeyDown(actionKeys[p][a]) || (gamepad && IsGamepadButtonDown(p, actionButtons[a]))) sample |= 1u << a;
+            }
+
+            taps = keyTaps[p];
+        }
+
+        // A press since the last frame counts even if the button is already released, or
+        // released and pressed again: queue it here, the release follows from the held mask
+        for (int a = 0; a < ACTION_COUNT; a++)
+        {
+            if (!(taps & (1u << a))) continue;
+
+            if (inputSampled[p] & (1u << a)) InputQueueEvent(p, (PlayerAction)a, false, source, framesCounter);
+            InputQueueEvent(p, (PlayerAction)a, true, source, framesCounter);
+            inputSampled[p] |= 1u << a;
+        }
+
+        unsigned int changed = sample ^ inputSampled[p];
+
+        for (int a = 0; a < ACTION_COUNT; a++)
+        {
+            if (changed & (1u << a)) InputQueueEvent(p, (PlayerAction)a, (sample & (1u << a)) != 0, source, framesCounter);
+        }
+
+        inputSampled[p] = sample;
+    }
+}
+
+// Stamp the raylib input poll that just ran, the input the next frame samples arrived since the previous one
+static void InputPolled(void)
+{
+    inputPollPrevious = inputPollTime;
+    inputPollTime = GetTime();
+}
+
+// Apply the queued input events due for this frame to the current player controls
+static void InputApply(void)
+{
+    InputQueue *queue = &inputQueue[Gr];
+
+    inputPressed[Gr] = 0;
+
+    while (queue->tail != queue->head)
+    {
+        InputEvent *event = &queue->events[queue->tail & (INPUT_QUEUE_SIZE - 1)];
+
+        if (event->tick > framesCounter) break;
+
+        if (event->pressed)
+        {
+            inputDown[Gr] |= 1u << event->action;
+            inputPressed[Gr] |= 1u << event->action;
+
+            EmitEvent(EVENT_ACTION, event->action, 0, 0);
+
+            if ((latencyFile != NULL) && (Gr < localPlayers) && (latencyPendingCount[Gr] < LATENCY_PENDING)) latencyPending[Gr][latencyPendingCount[Gr]++] = *event;
+        }
+        else inputDown[Gr] &= ~(1u << event->action);
+
+        queue->tail++;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Game events
+//--------------------------------------------------------------------------------------
+// Append an event of the current player to its ring
+static void EmitEvent(GameEventType type, int value, int x, int y)
+{
+    EmitEventTop(type, value, x, y, 0);
+}
+
+// Append the lock of the active piece, top is the grid row of its highest square
+static void EmitPieceLock(int top)
+{
+    EmitEventTop(EVENT_PIECE_LOCK, pieceType[Gr], piecePositionX[Gr], piecePositionY[Gr], top);
+}
+
+// Append an event of the current player to its ring with the top field set
+static void EmitEventTop(GameEventType type, int value, int x, int y, int top)
+{
+    EventRing *ring = &events[Gr];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    GameEvent *event = &ring->events[head & (EVENT_RING_SIZE - 1)];
+
+    // The release store of the previous head does not order the stores below after
+    // it, without this fence a reader could copy a half written slot and accept it
+    atomic_thread_fence(memory_order_release);
+
+    event->tick = framesCounter;
+    event->type = (uint8_t)type;
+    event->player = (uint8_t)Gr;
+    event->value = (int16_t)value;
+    event->x = (int8_t)x;
+    event->y = (int8_t)y;
+    event->top = (int8_t)top;
+
+    // Publish the event, consumers acquire the head before reading it
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Get the next event of a player for this reader, false when it is up to date
+static bool PollEvent(int player, EventReader *reader, GameEvent *event)
+{
+    EventRing *ring = &events[player];
+
+    while (true)
+    {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if (reader->position == head) return false;
+
+        // Skip what has already been overwritten. The slot of event head is written
+        // before head moves, so event head - EVENT_RING_SIZE may already be half gone
+        if (head - reader->position >= EVENT_RING_SIZE)
+        {
+            reader->dropped += head - reader->position - EVENT_RING_SIZE + 1;
+            reader->position = head - EVENT_RING_SIZE + 1;
+        }
+
+        *event = ring->events[reader->position & (EVENT_RING_SIZE - 1)];
+
+        // The writer may have lapped us while copying, in that case try again
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&ring->head, memory_order_relaxed) - reader->position < EVENT_RING_SIZE)
+        {
+            reader->position++;
+            return true;
+        }
+    }
+}
+
+// Refresh the HUD texts of the current player from its events, the simulation state is not read
+static void UpdateHud(void)
+{
+    GameEvent event;
+    int lineCount = -1;
+
+    while (PollEvent(Gr, &hudReader[Gr], &event))
+    {
+        if (event.type == EVENT_GAME_START) lineCount = 0;
+        else if (event.type == EVENT_LINES_CLEARED) lineCount = event.value;
+    }
+
+    if (lineCount >= 0) snprintf(hudLinesText[Gr], sizeof(hudLinesText[Gr]), "LINES:   %04i", lineCount);
+}
+
+//--------------------------------------------------------------------------------------
+// Player metrics
+//--------------------------------------------------------------------------------------
+// Metrics are another consumer of the event rings: every counter is updated
+// from the events of the frame, nothing is recomputed from the grid. The stack
+// height follows the locks (highest locked square) and the cleared lines.
+// Rates use simulated time, 60 frames per second, without the paused frames;
+// presses while paused are not counted.
+static bool MetricsOpen(const char *fileName)
+{
+    metricsFile = fopen(fileName, "wt");
+
+    if (metricsFile == NULL)
+    {
+        TraceLog(LOG_WARNING, "METRICS: [%s] Failed to open metrics file", fileName);
+        return false;
+    }
+
+    fprintf(metricsFile, "player,game,frames,pieces,pps,actions,apm,finesse_faults,singles,doubles,triples,tetrises,lines");
+    for (int b = 0; b < METRICS_HEIGHT_BANDS; b++) fprintf(metricsFile, ",height_%i_frames", b + 1);
+    fprintf(metricsFile, "\n");
+
+    return true;
+}
+
+static void MetricsClose(void)
+{
+    if (metricsFile == NULL) return;
+
+    fclose(metricsFile);
+    metricsFile = NULL;
+}
+
+// Account the frames spent at the current height and move the stack to a new one
+static void MetricsSetHeight(PlayerMetrics *m, uint32_t tick, int height)
+{
+    int rows = gridVerticalSize - 1;
+    int band = m->height*METRICS_HEIGHT_BANDS/rows;
+
+    m->heightFrames[(band < METRICS_HEIGHT_BANDS)? band : METRICS_HEIGHT_BANDS - 1] += tick - m->heightTick;
+    m->heightTick = tick;
+    m->height = (height < 0)? 0 : ((height > rows)? rows : height);
+}
+
+// Frames of the game played up to tick, the paused ones left out
+static uint32_t MetricsFrames(const PlayerMetrics *m, uint32_t tick)
+{
+    return tick - m->startTick - m->pausedFrames - (m->paused? tick - m->pauseTick : 0);
+}
+
+// Rebuild the HUD lines of the current player from its metrics
+static void MetricsFormat(const PlayerMetrics *m)
+{
+    uint32_t tick = m->playing? framesCounter : m->endTick;
+    uint32_t frames = MetricsFrames(m, tick);
+    float minutes = frames/3600.0f;
+    float pps = (minutes > 0.0f)? m->pieces/(minutes*60.0f) : 0.0f;
+    float apm = (minutes > 0.0f)? m->actions/minutes : 0.0f;
+    float share[METRICS_HEIGHT_BANDS] = { 0 };
+
+    if (frames > 0)
+    {
+        int rows = gridVerticalSize - 1;
+        int band = m->height*METRICS_HEIGHT_BANDS/rows;
+
+        // While paused the current band was already added up at the pause
+        for (int b = 0; b < METRICS_HEIGHT_BANDS; b++) share[b] = 100.0f*m->heightFrames[b]/frames;
+        if (m->playing && !m->paused) share[(band < METRICS_HEIGHT_BANDS)? band : METRICS_HEIGHT_BANDS - 1] += 100.0f*(tick - m->heightTick)/frames;
+    }
+
+    snprintf(hudMetricsText[Gr][0], sizeof(hudMetricsText[Gr][0]), "PPS: %.2f  APM: %.0f", pps, apm);
+    snprintf(hudMetricsText[Gr][1], sizeof(hudMetricsText[Gr][1]), "FINESSE FAULTS: %u", m->finesseFaults);
+    snprintf(hudMetricsText[Gr][2], sizeof(hudMetricsText[Gr][2]), "CLEARS: %u/%u/%u/%u", m->clears[0], m->clears[1], m->clears[2], m->clears[3]);
+    snprintf(hudMetricsText[Gr][3], sizeof(hudMetricsText[Gr][3]), "HEIGHT: %.0f/%.0f/%.0f/%.0f %%", share[0], share[1], share[2], share[3]);
+}
+
+// Write the metrics of a finished game, one CSV line
+static void MetricsWrite(const PlayerMetrics *m, int totalLines)
+{
+    uint32_t frames = MetricsFrames(m, m->endTick);
+    float minutes = frames/3600.0f;
+
+    fprintf(metricsFile, "%i,%i,%u,%u,%.3f,%u,%.1f,%u,%u,%u,%u,%u,%i", Gr + 1, m->game, frames, m->pieces,
+            (minutes > 0.0f)? m->pieces/(minutes*60.0f) : 0.0f, m->actions, (minutes > 0.0f)? m->actions/minutes : 0.0f,
+            m->finesseFaults, m->clears[0], m->clears[1], m->clears[2], m->clears[3], totalLines);
+    for (int b = 0; b < METRICS_HEIGHT_BANDS; b++) fprintf(metricsFile, ",%u", m->heightFrames[b]);
+    fprintf(metricsFile, "\n");
+    fflush(metricsFile);
+}
+
+// Update the metrics of the current player with its events of this frame
+static void UpdateMetrics(void)
+{
+    // Distinct orientations of each piece type, turning further only wastes presses
+    static const int orientations[7] = { 1, 4, 4, 2, 4, 2, 2 };
+
+    PlayerMetrics *m = &metrics[Gr];
+    GameEvent event;
+    bool changed = false;
+
+    while (PollEvent(Gr, &metricsReader[Gr], &event))
+    {
+        switch (event.type)
+        {
+            case EVENT_GAME_START:
+            {
+                // Lobby opponents start their next game even while paused
+                bool paused = m->paused;
+
+                memset(m, 0, sizeof(PlayerMetrics));
+                m->playing = true;
+                m->game = event.value;
+                m->startTick = event.tick;
+                m->heightTick = event.tick;
+                m->paused = paused;
+                m->pauseTick = event.tick;
+            } break;
+            case EVENT_GAME_PAUSE:
+            {
+                if (m->playing) MetricsSetHeight(m, event.tick, m->height);
+                m->paused = true;
+                m->pauseTick = event.tick;
+            } break;
+            case EVENT_GAME_RESUME:
+            {
+                if (!m->paused) break;
+
+                m->pausedFrames += event.tick - m->pauseTick;
+                m->heightTick = event.tick;
+                m->paused = false;
+            } break;
+            case EVENT_PIECE_SPAWN:
+            {
+                m->placing = true;
+                m->pieceType = event.value;
+                m->spawnX = event.x;
+                m->placementInputs = 0;
+                m->placementTurns = 0;
+            } break;
+            case EVENT_ACTION:
+            {
+                // Presses while paused do not play
+                if (!m->playing || m->paused) break;
+
+                m->actions++;
+                if (m->placing && (event.value != ACTION_DOWN)) m->placementInputs++;
+            } break;
+            case EVENT_PIECE_TURN: m->placementTurns++; break;
+            case EVENT_PIECE_LOCK:
+            {
+                // Minimum: one lateral press if the piece moved plus one turn press if it ends turned,
+                // holding a press auto-repeats at the tap rate so a single press reaches any column
+                int minimum = ((event.x != m->spawnX)? 1 : 0) + (((m->placementTurns%orientations[m->pieceType]) != 0)? 1 : 0);
+
+                if (m->placementInputs > minimum) m->finesseFaults += m->placementInputs - minimum;
+                m->pieces++;
+                m->placing = false;
+
+                int height = gridVerticalSize - 1 - event.top;
+                if (height > m->height) MetricsSetHeight(m, event.tick, height);
+            } break;
+            case EVENT_LINES_CLEARED:
+            {
+                if (event.x > 0) m->clears[((event.x < 4)? event.x : 4) - 1]++;
+                MetricsSetHeight(m, event.tick, m->height - event.x);
+            } break;
+            case EVENT_GAME_OVER:
+            {
+                MetricsSetHeight(m, event.tick, m->height);
+                m->playing = false;
+                m->placing = false;
+                m->endTick = event.tick;
+
+                if (metricsFile != NULL) MetricsWrite(m, event.value);
+            } break;
+            default: break;
+        }
+
+        changed = true;
+    }
+
+    if (changed || ((framesCounter%METRICS_REFRESH) == 0)) MetricsFormat(m);
+}
+
+//--------------------------------------------------------------------------------------
+// Training data export
+//--------------------------------------------------------------------------------------
+// Every placement is appended as a fixed size ExportRecord through a shared
+// mapping of the output file, so writing a record is a plain copy into memory.
+// The file grows EXPORT_GROW_RECORDS records at a time and is truncated to the
+// real record count on close.
+#if defined(SUPPORT_POSIX_MMAP)
+static bool ExportMap(uint64_t capacity)
+{
+    size_t size = sizeof(ExportHeader) + capacity*sizeof(ExportRecord);
+
+    if (ftruncate(exportFile, (off_t)size) != 0) return false;
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, exportFile, 0);
+    if (base == MAP_FAILED) return false;
+
+    exportBase = (uint8_t *)base;
+    exportCapacity = capacity;
+
+    return true;
+}
+
+static bool ExportOpen(const char *fileName)
+{
+    exportFile = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if ((exportFile < 0) || !ExportMap(EXPORT_GROW_RECORDS))
+    {
+        TraceLog(LOG_WARNING, "EXPORT: [%s] Failed to open export file", fileName);
+        if (exportFile >= 0) close(exportFile);
+        exportFile = -1;
+        return false;
+    }
+
+    ExportHeader *header = (ExportHeader *)exportBase;
+    memcpy(header->magic, EXPORT_MAGIC, sizeof(header->magic));
+    header->version = EXPORT_VERSION;
+    header->headerSize = sizeof(ExportHeader);
+    header->recordSize = sizeof(ExportRecord);
+    header->boardRows = EXPORT_BOARD_ROWS;
+    atomic_init(&header->recordCount, 0);
+
+    return true;
+}
+
+static void ExportClose(void)
+{
+    if (exportBase == NULL) return;
+
+    uint64_t count = atomic_load_explicit(&((ExportHeader *)exportBase)->recordCount, memory_order_relaxed);
+
+    munmap(exportBase, sizeof(ExportHeader) + exportCapacity*sizeof(ExportRecord));
+    if (ftruncate(exportFile, (off_t)(sizeof(ExportHeader) + count*sizeof(ExportRecord))) != 0) TraceLog(LOG_WARNING, "EXPORT: Failed to trim export file");
+    close(exportFile);
+
+    exportBase = NULL;
+    exportFile = -1;
+}
+
+static void ExportAppend(const ExportRecord *record)
+{
+    ExportHeader *header = (ExportHeader *)exportBase;
+    uint64_t count = atomic_load_explicit(&header->recordCount, memory_order_relaxed);
+
+    if (count == exportCapacity)
+    {
+        // Grow the file and map it again, this happens once every EXPORT_GROW_RECORDS records
+        munmap(exportBase, sizeof(ExportHeader) + exportCapacity*sizeof(ExportRecord));
+
+        if (!ExportMap(exportCapacity + EXPORT_GROW_RECORDS))
+        {
+            TraceLog(LOG_WARNING, "EXPORT: Failed to grow export file, export stopped");
+            close(exportFile);
+            exportBase = NULL;
+            exportFile = -1;
+            return;
+        }
+
+        header = (ExportHeader *)exportBase;
+    }
+
+    memcpy(exportBase + sizeof(ExportHeader) + count*sizeof(ExportRecord), record, sizeof(ExportRecord));
+
+    // Publish the record, readers acquire the count before reading it
+    atomic_store_explicit(&header->recordCount, count + 1, memory_order_release);
+}
+#else
+static bool ExportOpen(const char *fileName)
+{
+    TraceLog(LOG_WARNING, "EXPORT: [%s] Export is not supported on this platform", fileName);
+    return false;
+}
+
+static void ExportClose(void) { }
+static void ExportAppend(const ExportRecord *record) { (void)record; }
+#endif
+
+// Fill the pending record with everything known before the piece locks
+static void ExportBeginPlacement(void)
+{
+    ExportRecord *record = &exportPending[Gr];
+
+    memset(record, 0, sizeof(ExportRecord));
+
+    record->tick = framesCounter;
+    record->game = games[Gr];
+    record->pieceIndex = pieces[Gr];
+    record->totalLines = lines[Gr];
+    record->player = Gr;
+    record->pieceType = pieceType[Gr];
+    record->incomingType = incomingPieceType[Gr];
+    record->positionX = piecePositionX[Gr];
+    record->positionY = piecePositionY[Gr];
+    record->width = gridHorizontalSize - 2;
+    record->height = gridVerticalSize - 1;
+    record->piece = GetPieceMask(piece[Gr]);
+    record->incoming = GetPieceMask(incomingPiece[Gr]);
+    record->level = level[Gr];
+
+    for (int j = 0; (j < gridVerticalSize - 1) && (j < EXPORT_BOARD_ROWS); j++)
+    {
+        uint32_t row = 0;
+
+        for (int i = 1; i < gridHorizontalSize - 1; i++)
+        {
+            if (grid[Gr][i][j] == FULL) row |= 1u << (i - 1);
+        }
+
+        record->board[j] = row;
+    }
+
+    exportHasPending[Gr] = true;
+}
+
+// Complete the pending record with the outcome of the placement and append it
+static void ExportEndPlacement(void)
+{
+    ExportRecord *record = &exportPending[Gr];
+
+    // Completed lines were just marked as FADING by CheckCompletion()
+    record->linesCleared = CountFadingLines();
+    record->gameOver = gameOver[Gr];
+
+    exportHasPending[Gr] = false;
+
+    if (exportBase != NULL) ExportAppend(record);
+}
+
+//--------------------------------------------------------------------------------------
+// Lobby
+//--------------------------------------------------------------------------------------
+// Drawing 99 boards with the DrawGame() cell loop would cost thousands of
+// draw calls per frame. Opponents are drawn at a lower level of detail
+// instead: one texel per visible cell in a texture atlas. The atlas is another
+// consumer of the event rings: only the rectangles of the boards with events
+// that change what they look like are uploaded, and the atlas is drawn with a
+// single textured quad scaled up with point filtering.
+static void LobbyInit(void)
+{
+    int visibleRows = gridVerticalSize - gridHiddenRows;
+
+    atlasColumns = 1;
+    while (atlasColumns*atlasColumns < lobbyOpponents) atlasColumns++;
+
+    int atlasRows = (lobbyOpponents + atlasColumns - 1)/atlasColumns;
+
+    Image image = GenImageColor(atlasColumns*(gridHorizontalSize + 1), atlasRows*(visibleRows + 1), BLANK);
+    atlas = LoadTextureFromImage(image);
+    UnloadImage(image);
+
+    SetTextureFilter(atlas, TEXTURE_FILTER_POINT);
+}
+
+static void LobbyClose(void)
+{
+    if (atlas.id == 0) return;
+
+    UnloadTexture(atlas);
+    atlas.id = 0;
+}
+
+// Write the opponents boards changed since the last frame to the atlas
+static void LobbyUpdateAtlas(Color C1, Color C2, Color C3)
+{
+    int visibleRows = gridVerticalSize - gridHiddenRows;
+    Color pixels[GRID_MAX_HORIZONTAL_SIZE*GRID_MAX_VERTICAL_SIZE];
+
+    for (int p = 1; p <= lobbyOpponents; p++)
+    {
+        GameEvent event;
+        uint32_t dropped = atlasReader[p].dropped;
+        bool changed = atlasFading[p];
+
+        while (PollEvent(p, &atlasReader[p], &event))
+        {
+            if (event.type == EVENT_LINES_MARKED) atlasFading[p] = true;
+            else if (event.type == EVENT_LINES_CLEARED) atlasFading[p] = false;
+
+            // Presses, level changes and pauses leave the board as it was
+            if ((event.type != EVENT_ACTION) && (event.type != EVENT_LEVEL_CHANGE) &&
+                (event.type != EVENT_GAME_PAUSE) && (event.type != EVENT_GAME_RESUME)) changed = true;
+        }
+
+        // Missed events may have changed anything
+        if (atlasReader[p].dropped != dropped) changed = true;
+        if (!changed) continue;
+
+        // Finished boards stay in the atlas, faded until the opponent plays again
+        float alpha = gameOver[p]? 0.3f : 1.0f;
+        Color colors[5] = { Fade(RAYWHITE, alpha), Fade(C3, alpha), Fade(C2, alpha), Fade(C1, alpha), Fade(fadingColor[p], alpha) };
+
+        for (int j = 0; j < visibleRows; j++)
+        {
+            for (int i = 0; i < gridHorizontalSize; i++) pixels[j*gridHorizontalSize + i] = colors[grid[p][i][gridHiddenRows + j]];
+        }
+
+        Rectangle rec = { (float)(((p - 1)%atlasColumns)*(gridHorizontalSize + 1)), (float)(((p - 1)/atlasColumns)*(visibleRows + 1)),
+                          (float)gridHorizontalSize, (float)visibleRows };
+        UpdateTextureRec(atlas, rec, pixels);
+    }
+}
+
+// Draw every opponent from the atlas in the last third of the screen, the focused one outlined
+static void LobbyDraw(void)
+{
+    int areaX = 2*screenWidth/3;
+    int areaWidth = screenWidth - areaX - SQUARE_SIZE;
+    int areaHeight = screenHeight - 2*SQUARE_SIZE;
+
+    // Whole texels per cell when there is room for them
+    float scale = fminf((float)areaWidth/atlas.width, (float)areaHeight/atlas.height);
+    if (scale >= 1.0f) scale = floorf(scale);
+
+    Rectangle source = { 0.0f, 0.0f, (float)atlas.width, (float)atlas.height };
+    Rectangle dest = { (float)areaX + (areaWidth - atlas.width*scale)/2, (float)SQUARE_SIZE, atlas.width*scale, atlas.height*scale };
+
+    DrawTexturePro(atlas, source, dest, (Vector2){ 0.0f, 0.0f }, 0.0f, WHITE);
+
+    int visibleRows = gridVerticalSize - gridHiddenRows;
+    int focusX = (int)(dest.x + ((lobbyFocus - 1)%atlasColumns)*(gridHorizontalSize + 1)*scale);
+    int focusY = (int)(dest.y + ((lobbyFocus - 1)/atlasColumns)*(visibleRows + 1)*scale);
+
+    DrawRectangleLines(focusX - 1, focusY - 1, (int)(gridHorizontalSize*scale) + 2, (int)(visibleRows*scale) + 2, RED);
+    DrawText(TextFormat("%i OPPONENTS, [TAB] TO FOLLOW ANOTHER", lobbyOpponents), (int)dest.x, (int)(dest.y + dest.height) + 5, SQUARE_SIZE/2, GRAY);
+}
+
+//--------------------------------------------------------------------------------------
+// Live state feed
+//--------------------------------------------------------------------------------------
+// The state of every player is copied once per frame into a POSIX shared memory
+// object (FeedRegion) that overlays and bots map read only. Each player slot is
+// a seqlock, so the game never waits for readers. The same region carries an
+// input channel per player that lets an external process replace the keyboard.
+// That input is read once at the start of every frame and applies to that
+// frame, so it takes effect up to one frame period (16.7 ms at 60 fps) after
+// it is written; the press counters only make sure no press is lost.
+#if defined(SUPPORT_POSIX_MMAP)
+static bool FeedOpen(const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+
+    if ((fd < 0) || (ftruncate(fd, sizeof(FeedRegion)) != 0))
+    {
+        TraceLog(LOG_WARNING, "FEED: [%s] Failed to create shared memory object", name);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, sizeof(FeedRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        TraceLog(LOG_WARNING, "FEED: [%s] Failed to map shared memory object", name);
+        shm_unlink(name);
+        return false;
+    }
+
+    feed = (FeedRegion *)base;
+    memset(feed, 0, sizeof(FeedRegion));
+    feed->version = FEED_VERSION;
+    feed->size = sizeof(FeedRegion);
+    feedPlayers = (MAX_PLAYERS < FEED_MAX_PLAYERS)? MAX_PLAYERS : FEED_MAX_PLAYERS;
+    feed->players = (uint32_t)feedPlayers;
+
+    // Readers check the magic last, the rest of the header is valid once it is there
+    atomic_thread_fence(memory_order_release);
+    feed->magic = FEED_MAGIC;
+
+    snprintf(feedName, sizeof(feedName), "%s", name);
+
+    return true;
+}
+
+static void FeedClose(void)
+{
+    if (feed == NULL) return;
+
+    munmap(feed, sizeof(FeedRegion));
+    shm_unlink(feedName);
+    feed = NULL;
+    feedPlayers = 0;
+}
+
+// Latch the external input once per frame so every check in the frame sees the same buttons
+static void FeedReadInput(void)
+{
+    if (feed == NULL) return;
+
+    for (int p = 0; p < feedPlayers; p++)
+    {
+        FeedPlayer *slot = &feed->player[p];
+
+        feedDriven[p] = atomic_load_explicit(&slot->inputOwner, memory_order_acquire) != 0;
+        feedButtons[p] = feedDriven[p]? atomic_load_explicit(&slot->inputButtons, memory_order_acquire) : 0;
+        feedPresses[p] = 0;
+
+        // Counters are followed even while the keyboard drives the player, taking over is not a press
+        for (int a = 0; a < ACTION_COUNT; a++)
+        {
+            uint32_t presses = atomic_load_explicit(&slot->inputPresses[a], memory_order_acquire);
+
+            if (feedDriven[p] && (presses != feedPressCount[p][a])) feedPresses[p] |= 1u << a;
+            feedPressCount[p][a] = presses;
+        }
+    }
+}
+
+static void FeedPublish(void)
+{
+    if (feed == NULL) return;
+
+    for (int p = 0; p < feedPlayers; p++)
+    {
+        FeedPlayer *slot = &feed->player[p];
+        uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+
+        // Odd sequence: readers retry until the slot is complete again
+        atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        slot->tick = framesCounter;
+        slot->lines = lines[p];
+        slot->level = level[p];
+        slot->positionX = piecePositionX[p];
+        slot->positionY = piecePositionY[p];
+        slot->gameOver = gameOver[p];
+        slot->pieceActive = pieceActive[p];
+        slot->pieceType = pieceType[p];
+        slot->incomingType = incomingPieceType[p];
+        slot->piece = GetPieceMask(piece[p]);
+        slot->incoming = GetPieceMask(incomingPiece[p]);
+        slot->width = gridHorizontalSize;
+        slot->height = gridVerticalSize;
+
+        for (int j = 0; j < gridVerticalSize; j++)
+        {
+            for (int i = 0; i < gridHorizontalSize; i++) slot->cells[j][i] = (uint8_t)grid[p][i][j];
+        }
+
+        atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    }
+}
+#else
+static bool FeedOpen(const char *name)
+{
+    TraceLog(LOG_WARNING, "FEED: [%s] Shared memory feed is not supported on this platform", name);
+    return false;
+}
+
+static void FeedClose(void) { }
+static void FeedReadInput(void) { }
+static void FeedPublish(void) { }
+#endif
+
+//--------------------------------------------------------------------------------------
+// Input to photon latency measurement
+//--------------------------------------------------------------------------------------
+// Every press consumed by a frame is kept until that frame is presented. A press
+// is only known to have arrived between two input polls (InputEvent.arrival and
+// InputEvent.time), so a sample is the interval from either end to the present
+// and its midpoint is what the percentiles use. With SUPPORT_CUSTOM_FRAME_CONTROL
+// the present is stamped right after SwapScreenBuffer(); otherwise only when
+// EndDrawing() returns, after its frame pacing wait and input poll as well.
+// Samples are written to the file as they come and summarized per player as
+// p50/p99, on screen and at the end of the file.
+static int CompareFloat(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+
+    return (fa > fb) - (fa < fb);
+}
+
+// Compute the p50/p99 latency of a player from its kept samples
+static void LatencyPercentiles(int player, float *p50, float *p99)
+{
+    static float sorted[LATENCY_SAMPLES];
+    int count = (latencySampleCount[player] < LATENCY_SAMPLES)? (int)latencySampleCount[player] : LATENCY_SAMPLES;
+
+    *p50 = 0.0f;
+    *p99 = 0.0f;
+    if (count == 0) return;
+
+    memcpy(sorted, latencySamples[player], count*sizeof(float));
+    qsort(sorted, count, sizeof(float), CompareFloat);
+
+    *p50 = sorted[(count - 1)*50/100];
+    *p99 = sorted[(count - 1)*99/100];
+}
+
+static bool LatencyOpen(const char *fileName)
+{
+    latencyFile = fopen(fileName, "wt");
+
+    if (latencyFile == NULL)
+    {
+        TraceLog(LOG_WARNING, "LATENCY: [%s] Failed to open latency file", fileName);
+        return false;
+    }
+
+    fprintf(latencyFile, "player,frame,source,latency_ms,min_ms,max_ms\n");
+
+    return true;
+}
+
+static void LatencyClose(void)
+{
+    if (latencyFile == NULL) return;
+
+    for (int p = 0; p < localPlayers; p++)
+    {
+        float p50, p99;
+
+        LatencyPercentiles(p, &p50, &p99);
+        fprintf(latencyFile, "# player %i: %u samples, p50 %.2f ms, p99 %.2f ms\n", p + 1, latencySampleCount[p], p50, p99);
+    }
+
+    fclose(latencyFile);
+    latencyFile = NULL;
+}
+
+// Turn the presses consumed by the frame just presented into latency samples
+static void LatencyPresent(double presentTime)
+{
+    for (int p = 0; p < localPlayers; p++)
+    {
+        bool firstSamples = (latencySampleCount[p] == 0) && (latencyPendingCount[p] > 0);
+
+        for (int i = 0; i < latencyPendingCount[p]; i++)
+        {
+            InputEvent *event = &latencyPending[p][i];
+            float minimum = (float)((presentTime - event->time)*1000.0);
+            float maximum = (float)((presentTime - event->arrival)*1000.0);
+            float latency = (minimum + maximum)/2.0f;
+
+            latencySamples[p][latencySampleCount[p]%LATENCY_SAMPLES] = latency;
+            latencySampleCount[p]++;
+
+            fprintf(latencyFile, "%i,%u,%i,%.3f,%.3f,%.3f\n", p + 1, event->tick, event->source, latency, minimum, maximum);
+        }
+
+        latencyPendingCount[p] = 0;
+
+        // Percentiles are shown from the first sample on, then refreshed now and then
+        if (firstSamples || ((framesCounter%LATENCY_REFRESH) == 0)) LatencyPercentiles(p, &latencyP50[p], &latencyP99[p]);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Reference engine harness
+//--------------------------------------------------------------------------------------
+// -harness <ticks> runs without a window. Slot 0 plays with the reference
+// engine and slot 1 with the engine picked for the board size (the
+// candidate), both fed by bots with the same seeds, so the pieces and the
+// inputs are the same. After every tick the whole state of both slots is
+// compared and the first difference is reported with its tick. Then each
+// engine plays the same ticks alone to time it.
+static double NowSeconds(void)
+{
+    struct timespec now;
+
+    timespec_get(&now, TIME_UTC);
+
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+// Start the harness slots over, all of them with the same seed
+static void HarnessReset(int slots, uint32_t seed)
+{
+    framesCounter = 0;
+    gamePaused = false;
+    MAX_PLAYERS = slots;
+    localPlayers = 0;       // Every slot is played by a bot
+
+    for (Gr = 0; Gr < slots; Gr++)
+    {
+        pieceRandom[Gr] = seed*2654435761u | 1;
+        botRandom[Gr] = seed*2246822519u | 1;
+
+        memset(&inputQueue[Gr], 0, sizeof(InputQueue));
+        inputSampled[Gr] = 0;
+        inputDown[Gr] = 0;
+        inputPressed[Gr] = 0;
+
+        memset(piece[Gr], 0, sizeof(piece[Gr]));
+        gameOver[Gr] = false;
+        games[Gr] = 0;
+
+        InitGame();
+    }
+
+    Gr = 0;
+}
+
+// Simulate one tick of the harness slots, slot p with engines[p]
+static void HarnessStep(const BoardOps **engines, int slots)
+{
+    framesCounter++;
+
+    InputPoll();
+
+    for (Gr = 0; Gr < slots; Gr++)
+    {
+        board = engines[Gr];
+
+        InputApply();
+        UpdateGame();
+    }
+
+    Gr = 0;
+}
+
+#define HARNESS_COMPARE(field) if (memcmp(&field[0], &field[1], sizeof(field[0])) != 0) return #field
+
+// Get the name of the first part of the state that differs between slots 0 and 1, NULL if none
+static const char *HarnessCompare(void)
+{
+    HARNESS_COMPARE(grid);
+    HARNESS_COMPARE(piece);
+    HARNESS_COMPARE(incomingPiece);
+    HARNESS_COMPARE(piecePositionX);
+    HARNESS_COMPARE(piecePositionY);
+    HARNESS_COMPARE(pieceType);
+    HARNESS_COMPARE(incomingPieceType);
+    HARNESS_COMPARE(fadingColor);
+    HARNESS_COMPARE(gameOver);
+    HARNESS_COMPARE(beginPlay);
+    HARNESS_COMPARE(pieceActive);
+    HARNESS_COMPARE(detection);
+    HARNESS_COMPARE(lineToDelete);
+    HARNESS_COMPARE(level);
+    HARNESS_COMPARE(lines);
+    HARNESS_COMPARE(games);
+    HARNESS_COMPARE(pieces);
+    HARNESS_COMPARE(gravityMovementCounter);
+    HARNESS_COMPARE(lateralMovementCounter);
+    HARNESS_COMPARE(lateralMovementDelay);
+    HARNESS_COMPARE(turnMovementCounter);
+    HARNESS_COMPARE(fastFallMovementCounter);
+    HARNESS_COMPARE(fadeLineCounter);
+    HARNESS_COMPARE(botRestartCounter);
+    HARNESS_COMPARE(pieceRandom);
+    HARNESS_COMPARE(inputDown);
+
+    if (atomic_load(&events[0].head) != atomic_load(&events[1].head)) return "events";
+
+    // The ring entries too, all but the player number that tells the slots apart
+    for (int k = 0; k < EVENT_RING_SIZE; k++)
+    {
+        GameEvent event = events[1].events[k];
+
+        event.player = events[0].events[k].player;
+        if (memcmp(&events[0].events[k], &event, sizeof(GameEvent)) != 0) return "events";
+    }
+
+    return NULL;
+}
+
+// Print the grids of both slots side by side: . empty, M moving, F full, B block, * fading
+static void HarnessPrintGrids(void)
+{
+    printf("reference%*s%s\n", gridHorizontalSize - 9 + 4, "", board->name);
+
+    for (int j = 0; j < gridVerticalSize; j++)
+    {
+        for (int p = 0; p < 2; p++)
+        {
+            for (int i = 0; i < gridHorizontalSize; i++) putchar(".MFB*"[grid[p][i][j]]);
+            printf((p == 0)? "    " : "\n");
+        }
+    }
+}
+
+static int HarnessRun(unsigned int ticks, uint32_t seed)
+{
+    const BoardOps *candidate = board;
+    const BoardOps *engines[2] = { &boardOpsReference, candidate };
+    const char *difference = NULL;
+    unsigned int divergence = 0;
+    int divergenceGame = 0;
+    double seconds[2] = { 0 };
+
+    if (candidate == &boardOpsReference)
+    {
+        printf("HARNESS: no candidate engine for the %ix%i board, nothing to compare\n", gridHorizontalSize - 2, gridVerticalSize - 1);
+        return 1;
+    }
+
+    printf("HARNESS: %s engine against the reference, %ix%i board, %u ticks, seed %u\n",
+           candidate->name, gridHorizontalSize - 2, gridVerticalSize - 1, ticks, seed);
+
+    // Both engines side by side on the same input
+    HarnessReset(2, seed);
+
+    for (unsigned int t = 0; (t < ticks) && (difference == NULL); t++)
+    {
+        HarnessStep(engines, 2);
+        difference = HarnessCompare();
+    }
+
+    if (difference != NULL)
+    {
+        divergence = framesCounter;
+        divergenceGame = games[0];
+        HarnessPrintGrids();
+    }
+
+    // Each engine alone, the same ticks
+    for (int e = 0; e < 2; e++)
+    {
+        HarnessReset(1, seed);
+
+        double start = NowSeconds();
+        for (unsigned int t = 0; t < ticks; t++) HarnessStep(&engines[e], 1);
+        seconds[e] = NowSeconds() - start;
+    }
+
+    board = candidate;
+
+    printf("HARNESS: reference %.3f s (%.1f ns/tick), %s %.3f s (%.1f ns/tick), speedup %.2fx\n",
+           seconds[0], seconds[0]*1e9/ticks, candidate->name, seconds[1], seconds[1]*1e9/ticks,
+           (seconds[1] > 0.0)? seconds[0]/seconds[1] : 0.0);
+
+    if (difference == NULL) printf("HARNESS: no divergence in %u ticks\n", ticks);
+    else printf("HARNESS: first divergence at tick %u, %s differs (game %i)\n", divergence, difference, divergenceGame);
+
+    return (difference == NULL)? 0 : 1;
+}